@@ -5,6 +5,14 @@
 #include <assert.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "mymem.h"
 #include "testrunner.h"
@@ -23,7 +31,7 @@ void do_randomized_test(int strategyToUse, int totalSize, float fillRatio, int m
 	int storedPointers = 0;
 	int strategy;
 	int lbound = 1;
-	int ubound = 4;
+	int ubound = NUM_STRATEGIES;
 	int smallBlockSize = maxBlockSize/10;
 
 	if (strategyToUse>0)
@@ -94,7 +102,8 @@ void do_randomized_test(int strategyToUse, int totalSize, float fillRatio, int m
 			}
 
 			sum_largest_free += mem_largest_free();
-			sum_hole_size += (mem_free() / mem_holes());
+			if (mem_holes() > 0) /* a full pool has no holes */
+				sum_hole_size += (mem_free() / mem_holes());
 			sum_allocated += mem_allocated();
 			sum_small += mem_small_free(smallBlockSize);
 		}
@@ -152,30 +161,259 @@ int do_stress_tests(int argc, char **argv)
 	return 0; /* you nominally pass for surviving without segfaulting */
 }
 
+/* One thread's share of a threaded test: random allocations and frees on the default pool.
+	Every block is filled with a byte of its own and checked before it is freed. */
+struct thread_work
+{
+	int seed;
+	int operations;
+	int corrupted;
+	int failed_allocations;
+};
+
+void *do_thread_work(void *arg)
+{
+	struct thread_work *work = arg;
+	unsigned char *pointers[64];
+	int sizes[64];
+	int stored = 0;
+	unsigned int seed = work->seed;
+	int i;
+
+	for (i = 0; i < work->operations; i++)
+	{
+		if (stored < 64 && (stored == 0 || rand_r(&seed) % 2))
+		{
+			int size = rand_r(&seed) % 300 + 1;
+			unsigned char *pointer = mymalloc(size);
+			if (pointer == NULL)
+			{
+				work->failed_allocations++;
+				continue;
+			}
+			memset(pointer, (unsigned char)(work->seed + size), size);
+			pointers[stored] = pointer;
+			sizes[stored] = size;
+			stored++;
+		}
+		else
+		{
+			int chosen = rand_r(&seed) % stored;
+			int j;
+			for (j = 0; j < sizes[chosen]; j++)
+				if (pointers[chosen][j] != (unsigned char)(work->seed + sizes[chosen]))
+					work->corrupted = 1;
+			myfree(pointers[chosen]);
+			stored--;
+			pointers[chosen] = pointers[stored];
+			sizes[chosen] = sizes[stored];
+		}
+	}
+	while (stored > 0)
+		myfree(pointers[--stored]);
+	return NULL;
+}
+
+/* Runs do_thread_work() on the given number of threads at once.
+	Returns the total alloc/free throughput in operations per second, or -1 if a block was corrupted. */
+double run_threads(int threads, int operations)
+{
+	pthread_t ids[16];
+	struct thread_work work[16];
+	struct timespec execstart, execend;
+	int corrupted = 0;
+	int t;
+
+	clock_gettime(CLOCK_MONOTONIC, &execstart);
+	for (t = 0; t < threads; t++)
+	{
+		work[t].seed = t + 1;
+		work[t].operations = operations;
+		work[t].corrupted = 0;
+		work[t].failed_allocations = 0;
+		pthread_create(&ids[t], NULL, do_thread_work, &work[t]);
+	}
+	for (t = 0; t < threads; t++)
+	{
+		pthread_join(ids[t], NULL);
+		corrupted |= work[t].corrupted;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &execend);
+
+	if (corrupted)
+		return -1;
+	return (double)threads * operations / ((execend.tv_sec - execstart.tv_sec) + (execend.tv_nsec - execstart.tv_nsec) / 1e9);
+}
+
+/* Blocks passed from the producer to one consumer: a ring that one thread fills and another empties */
+#define HANDOFF_SLOTS 256
+
+struct handoff
+{
+	void *slots[HANDOFF_SLOTS];
+	atomic_int head; /* next slot to fill */
+	atomic_int tail; /* next slot to empty */
+	int blocks;      /* blocks the consumer freed */
+	int corrupted;
+};
+
+void *do_consumer_work(void *arg)
+{
+	struct handoff *ring = arg;
+
+	for (;;)
+	{
+		int tail = atomic_load(&ring->tail);
+		unsigned char *block;
+		if (tail == atomic_load(&ring->head))
+		{
+			sched_yield();
+			continue;
+		}
+		block = ring->slots[tail % HANDOFF_SLOTS];
+		atomic_store(&ring->tail, tail + 1);
+		if (block == NULL)
+			return NULL;
+		if (block[0] != (unsigned char)ring->blocks)
+			ring->corrupted = 1;
+		ring->blocks++;
+		myfree(block);
+	}
+}
+
+/* One producer allocates blocks of 16 to 256 bytes and hands them round-robin to the consumers, which free them.
+	Returns blocks per second, or -1 if a consumer saw a block overwritten. */
+double producer_consumer_rate(int strategy, int flags, int consumers, int blocks)
+{
+	pthread_t ids[16];
+	struct handoff *rings = calloc(consumers, sizeof(struct handoff));
+	struct timespec execstart, execend;
+	int corrupted = 0;
+	int i;
+
+	initmem_arenas(strategy, 1 << 20, flags, consumers + 1);
+	clock_gettime(CLOCK_MONOTONIC, &execstart);
+	for (i = 0; i < consumers; i++)
+		pthread_create(&ids[i], NULL, do_consumer_work, &rings[i]);
+	for (i = 0; i < blocks + consumers; i++)
+	{
+		struct handoff *ring = &rings[i % consumers];
+		unsigned char *block = NULL;
+		int head = atomic_load(&ring->head);
+
+		if (i < blocks)
+		{
+			while ((block = mymalloc(16 + i % 241)) == NULL)
+				sched_yield();
+			block[0] = (unsigned char)(i / consumers);
+		}
+		while (head - atomic_load(&ring->tail) == HANDOFF_SLOTS)
+			sched_yield();
+		ring->slots[head % HANDOFF_SLOTS] = block;
+		atomic_store(&ring->head, head + 1);
+	}
+	for (i = 0; i < consumers; i++)
+	{
+		pthread_join(ids[i], NULL);
+		corrupted |= rings[i].corrupted;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &execend);
+
+	free(rings);
+	if (corrupted || mem_allocated() != 0)
+		return -1;
+	return blocks / ((execend.tv_sec - execstart.tv_sec) + (execend.tv_nsec - execstart.tv_nsec) / 1e9);
+}
+
+/* run the randomized workload from 1 to 8 threads sharing one pool, with one lock, with thread caches
+	and with one arena per thread, and log how the throughput scales */
+int do_threaded_stress_tests(int argc, char **argv)
+{
+	int threadCounts[] = {1, 2, 4, 8};
+	int operations = 20000;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+	int c;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("tests.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Running threaded tests: pool size == %d, block size is from 1 to 300, %d operations per thread\n",1 << 20,operations);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		fprintf(log,"\t=== %s ===\n",strategy_name(strategy));
+		for (c = 0; c < sizeof(threadCounts)/sizeof(threadCounts[0]); c++)
+		{
+			double locked, cached, arenas;
+
+			initmem(strategy, 1 << 20);
+			locked = run_threads(threadCounts[c], operations);
+			initmem_flags(strategy, 1 << 20, MEM_THREAD_CACHE);
+			cached = run_threads(threadCounts[c], operations);
+			initmem_arenas(strategy, 1 << 20, 0, threadCounts[c]);
+			arenas = run_threads(threadCounts[c], operations);
+			if (locked < 0 || cached < 0 || arenas < 0)
+			{
+				printf("Block overwritten by another thread with %s\n", strategy_name(strategy));
+				fclose(log);
+				return 1;
+			}
+			fprintf(log,"\t%d threads: %10.0f ops/sec locked, %10.0f ops/sec with thread caches, %10.0f ops/sec with one arena per thread\n",threadCounts[c],locked,cached,arenas);
+		}
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* bytes a block of size bytes takes up: Buddy rounds it up to a power of two, Bitmap to whole 16 byte granules */
+int block_size(strategies strategy, int size)
+{
+	int rounded = 1;
+
+	if (strategy == Bitmap)
+		return (size + 15) / 16 * 16;
+	if (strategy != Buddy)
+		return size;
+	while (rounded < size)
+		rounded *= 2;
+	return rounded;
+}
+
 /* basic sequential allocation of single byte blocks */
 int test_alloc_1(int argc, char **argv) {
 	strategies strategy;
 	int lbound = 1;
-	int ubound = 4;
+	int ubound = NUM_STRATEGIES;
 
 	if (strategyFromString(*(argv+1))>0)
 		lbound=ubound=strategyFromString(*(argv+1));
 
 	for (strategy = lbound; strategy <= ubound; strategy++)
 	{
+		int unit = block_size(strategy, 1);
 		int correct_holes = 0;
-		int correct_alloc = 100;
+		int correct_alloc = 100 * unit;
 		int correct_largest_free = 0;
 		int i;
 
 		void* lastPointer = NULL;
-		initmem(strategy,100);
+		initmem(strategy,100 * unit);
 		for (i = 0; i < 100; i++)
 		{
 			void* pointer = mymalloc(1);
-			if ( i > 0 && pointer != (lastPointer+1) )
+			/* Buddy takes the smallest block that fits, so it fills the 4 bytes at the end of the pool first */
+			if ( i > 0 && strategy != Buddy && pointer != (lastPointer+unit) )
 			{
-				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+1,pointer);
+				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+unit,pointer);
 				return 1;
 			}
 			lastPointer = pointer;
@@ -209,7 +447,7 @@ int test_alloc_1(int argc, char **argv) {
 int test_alloc_2(int argc, char **argv) {
 	strategies strategy;
 	int lbound = 1;
-	int ubound = 4;
+	int ubound = NUM_STRATEGIES;
 
 	if (strategyFromString(*(argv+1))>0)
 		lbound=ubound=strategyFromString(*(argv+1));
@@ -232,14 +470,15 @@ int test_alloc_2(int argc, char **argv) {
 		myfree(first);
 		third = mymalloc(1);
 
-		if (second != (first+10))
+		/* Buddy takes the smallest block that fits: the 4 bytes at the end of the pool */
+		if (second != (strategy == Buddy ? mem_pool()+96 : first+block_size(strategy, 10)))
 		{
 			printf("Second allocation failed; allocated at incorrect offset with strategy %s", strategy_name(strategy));
 			return 1;
 		}
 
-		correct_alloc = 2;
-		correct_small = (strategy == First || strategy == Best);
+		correct_alloc = 2 * block_size(strategy, 1);
+		correct_small = (strategy == First || strategy == Best || strategy == Tlsf || strategy == Buddy);
 
 		switch (strategy)
 		{
@@ -263,6 +502,23 @@ int test_alloc_2(int argc, char **argv) {
 				correct_holes = 2;
 				correct_largest_free = 88;
 				break;
+			case Tlsf:
+				correctThird = (third == first);
+				correct_holes = 2;
+				correct_largest_free = 89;
+				break;
+			case Buddy:
+				/* 64 at 0, 32 at 64 where first was, and the 2 bytes after the third */
+				correctThird = (third == second+1);
+				correct_holes = 3;
+				correct_largest_free = 64;
+				break;
+			case Bitmap:
+				/* granules 2 to 5 and the 4 bytes after them, which are too few for a granule */
+				correctThird = (third == first);
+				correct_holes = 1;
+				correct_largest_free = 68;
+				break;
 		        case NotSet:
 			        break;
 		}
@@ -307,26 +563,28 @@ int test_alloc_2(int argc, char **argv) {
 int test_alloc_3(int argc, char **argv) {
 	strategies strategy;
 	int lbound = 1;
-	int ubound = 4;
+	int ubound = NUM_STRATEGIES;
 
 	if (strategyFromString(*(argv+1))>0)
 		lbound=ubound=strategyFromString(*(argv+1));
 
 	for (strategy = lbound; strategy <= ubound; strategy++)
 	{
+		int unit = block_size(strategy, 1);
 		int correct_holes = 50;
-		int correct_alloc = 50;
-		int correct_largest_free = 1;
+		int correct_alloc = 50 * unit;
+		int correct_largest_free = unit;
 		int i;
 
 		void* lastPointer = NULL;
-		initmem(strategy,100);
+		initmem(strategy,100 * unit);
 		for (i = 0; i < 100; i++)
 		{
 			void* pointer = mymalloc(1);
-			if ( i > 0 && pointer != (lastPointer+1) )
+			/* Buddy takes the smallest block that fits, so it fills the 4 bytes at the end of the pool first */
+			if ( i > 0 && strategy != Buddy && pointer != (lastPointer+unit) )
 			{
-				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+1,pointer);
+				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+unit,pointer);
 				return 1;
 			}
 			lastPointer = pointer;
@@ -334,7 +592,7 @@ int test_alloc_3(int argc, char **argv) {
 
 		for (i = 1; i < 100; i+= 2)
 		{
-			myfree(mem_pool() + i);
+			myfree(mem_pool() + i * unit);
 		}
 
 		if (mem_holes() != correct_holes)
@@ -356,7 +614,7 @@ int test_alloc_3(int argc, char **argv) {
 		}
 
 		for(i=0;i<100;i++) {
-		  if(mem_is_alloc(mem_pool()+i) == i%2) {
+		  if(mem_is_alloc(mem_pool()+i*unit) == i%2) {
 		    printf("Byte %d in memory claims to ",i);
 		    if(i%2)
 		      printf("not ");
@@ -377,26 +635,28 @@ int test_alloc_3(int argc, char **argv) {
 int test_alloc_4(int argc, char **argv) {
 	strategies strategy;
 	int lbound = 1;
-	int ubound = 4;
+	int ubound = NUM_STRATEGIES;
 
 	if (strategyFromString(*(argv+1))>0)
 		lbound=ubound=strategyFromString(*(argv+1));
 
 	for (strategy = lbound; strategy <= ubound; strategy++)
 	{
+		int unit = block_size(strategy, 1);
 		int correct_holes = 0;
-		int correct_alloc = 100;
+		int correct_alloc = 100 * unit;
 		int correct_largest_free = 0;
 		int i;
 
 		void* lastPointer = NULL;
-		initmem(strategy,100);
+		initmem(strategy,100 * unit);
 		for (i = 0; i < 100; i++)
 		{
 			void* pointer = mymalloc(1);
-			if ( i > 0 && pointer != (lastPointer+1) )
+			/* Buddy takes the smallest block that fits, so it fills the 4 bytes at the end of the pool first */
+			if ( i > 0 && strategy != Buddy && pointer != (lastPointer+unit) )
 			{
-				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+1,pointer);
+				printf("Allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+unit,pointer);
 				return 1;
 			}
 			lastPointer = pointer;
@@ -404,15 +664,16 @@ int test_alloc_4(int argc, char **argv) {
 
 		for (i = 1; i < 100; i+= 2)
 		{
-			myfree(mem_pool() + i);
+			myfree(mem_pool() + i * unit);
 		}
 
 		for (i = 1; i < 100; i+=2)
 		{
 			void* pointer = mymalloc(1);
-			if ( i > 1 && pointer != (lastPointer+2) )
+			/* every hole is a single byte with Buddy, and it takes them in no particular order */
+			if ( i > 1 && strategy != Buddy && pointer != (lastPointer+2*unit) )
 			{
-				printf("Second allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+1,pointer);
+				printf("Second allocation with %s was not sequential at %i; expected %p, actual %p\n", strategy_name(strategy), i,lastPointer+2*unit,pointer);
 				return 1;
 			}
 			lastPointer = pointer;
@@ -442,6 +703,2275 @@ int test_alloc_4(int argc, char **argv) {
 }
 
 
+/* small-block counts and the free size histogram for holes of 10, 20, 100 and 867 bytes, as each strategy rounds them */
+int test_free_histogram(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		int thresholds[] = {9, 10, 19, 20, 99, 100, 866, 867};
+		/* Bitmap holes are 16, 32, 112 and 792 bytes; Buddy leaves 512, 256, 128, 64, 32, 4 and 1 */
+		int exact_small[] = {0, 1, 1, 2, 2, 3, 3, 4};
+		int bitmap_small[] = {0, 0, 1, 1, 2, 2, 4, 4};
+		int buddy_small[] = {2, 2, 2, 2, 4, 4, 7, 7};
+		int exact_counts[] = {0, 0, 0, 1, 1, 0, 1, 0, 0, 1};
+		int bitmap_counts[] = {0, 0, 0, 0, 1, 1, 1, 0, 0, 1};
+		int buddy_counts[] = {1, 0, 1, 0, 0, 1, 1, 1, 1, 1};
+		int *correct_small = strategy == Bitmap ? bitmap_small : strategy == Buddy ? buddy_small : exact_small;
+		int *correct_counts = strategy == Bitmap ? bitmap_counts : strategy == Buddy ? buddy_counts : exact_counts;
+		int counts[12];
+		int used;
+		int larger = 0;
+		int i;
+		void *a, *c, *e;
+
+		//A 0 byte pool is one empty hole, which goes in the first bucket
+		initmem(strategy,0);
+		if (mymalloc(1) != NULL || mem_holes() != 1)
+		{
+			printf("A 0 byte pool is not a single empty hole with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (mem_free_histogram(counts, 12) != 1 || counts[0] != 1)
+		{
+			printf("Free histogram of a 0 byte pool is wrong with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		initmem(strategy,1000);
+
+		a = mymalloc(10);
+		mymalloc(1);
+		c = mymalloc(20);
+		mymalloc(1);
+		e = mymalloc(100);
+		mymalloc(1);
+		myfree(a);
+		myfree(c);
+		myfree(e);
+
+		for (i = 0; i < sizeof(thresholds)/sizeof(thresholds[0]); i++)
+		{
+			if (mem_small_free(thresholds[i]) != correct_small[i])
+			{
+				printf("Small holes of at most %d bytes counted as %d, should be %d with %s\n", thresholds[i], mem_small_free(thresholds[i]), correct_small[i], strategy_name(strategy));
+				return 1;
+			}
+		}
+
+		used = mem_free_histogram(counts, 12);
+		for (i = 0; i < 12; i++)
+		{
+			if (counts[i] != (i < 10 ? correct_counts[i] : 0))
+				used = -1;
+		}
+		if (used != 10)
+		{
+			printf("Free histogram is wrong with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		//Everything from bucket 4 up is folded into the last of 5 buckets
+		for (i = 4; i < 10; i++)
+			larger += correct_counts[i];
+		mem_free_histogram(counts, 5);
+		if (counts[3] != correct_counts[3] || counts[4] != larger)
+		{
+			printf("Free histogram does not fold large blocks into the last bucket with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* every byte of a block, not just the first, is reported as allocated, up to the end of the rounded block */
+int test_interior_bytes(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		void *first;
+		void *second;
+		void *third;
+		int i;
+
+		initmem(strategy,100);
+
+		first = mymalloc(10);
+		second = mymalloc(20);
+		third = mymalloc(5);
+		myfree(first);
+
+		/* Bitmap puts the blocks at granules 1 and 3; Buddy puts them in the 64 byte block at 0 and the 32 byte one at 64 */
+		if (second != mem_pool() + (strategy == Bitmap ? 16 : strategy == Buddy ? 0 : 10)
+			|| third != mem_pool() + (strategy == Bitmap ? 48 : strategy == Buddy ? 80 : 30))
+		{
+			printf("Blocks placed at %ld and %ld with %s\n", (long)(second - mem_pool()), (long)(third - mem_pool()), strategy_name(strategy));
+			return 1;
+		}
+
+		if (mem_is_alloc(mem_pool() - 1) || mem_is_alloc(mem_pool() + 100))
+		{
+			printf("Bytes outside the pool claim to be allocated with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* bytes 10-34 allocated and the rest free; 16-63 with Bitmap, 0-31 and 80-87 with Buddy */
+		for (i = 0; i < 100; i++)
+		{
+			char correct = (mem_pool() + i >= second && mem_pool() + i < second + block_size(strategy, 20))
+				|| (mem_pool() + i >= third && mem_pool() + i < third + block_size(strategy, 5));
+			if (mem_is_alloc(mem_pool() + i) != correct)
+			{
+				printf("Byte %d in memory claims to %sbe allocated with %s\n", i, correct ? "not " : "", strategy_name(strategy));
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* blocks are freed, and pointers into them ignored, while the table that finds them is being moved to a larger one */
+int test_alloc_table(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+	int n = 20000;
+	void **pointers = malloc(n * sizeof(void *));
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		int i;
+
+		initmem(strategy, (size_t)n * 16);
+		srand(strategy);
+		for (i = 0; i < n; i++)
+		{
+			int j = rand() % (i + 1);
+			pointers[i] = mymalloc(16);
+			if (pointers[i] == NULL)
+			{
+				printf("Allocation %d of %d failed with %s\n", i, n, strategy_name(strategy));
+				return 1;
+			}
+			/* swap a random earlier block to the end and free it now and then */
+			void *tmp = pointers[i];
+			pointers[i] = pointers[j];
+			pointers[j] = tmp;
+			if (rand() % 3 == 0)
+			{
+				myfree(pointers[i]);
+				pointers[i] = NULL;
+			}
+			/* not the start of a block, so it has to be looked up in both tables and ignored */
+			if (pointers[j] != NULL)
+				myfree((char *)pointers[j] + 8);
+		}
+		for (i = 0; i < n; i++)
+			myfree(pointers[i]);
+
+		if (mem_allocated() != 0 || mem_free() != n * 16)
+		{
+			printf("%d bytes still allocated after freeing every block with %s\n", mem_allocated(), strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	free(pointers);
+	return 0;
+}
+
+/* buddy blocks are split down to the rounded size and merge back with their buddies when freed */
+int test_buddy(int argc, char **argv) {
+	void *a, *b, *c;
+	double external;
+
+	initmem(Buddy,1024);
+
+	a = mymalloc(100);
+	b = mymalloc(128);
+	c = mymalloc(64);
+	if (a != mem_pool() || b != a + 128 || c != a + 256)
+	{
+		printf("Buddy blocks not split at power-of-two offsets\n");
+		return 1;
+	}
+	if (mem_allocated() != 320 || mem_internal_fragmentation() != 28 || !mem_is_alloc(a + 127))
+	{
+		printf("Buddy did not round 100 bytes up to 128\n");
+		return 1;
+	}
+	/* free: 64 at 320, 128 at 384, 512 at 512 */
+	if (mem_holes() != 3 || mem_largest_free() != 512)
+	{
+		printf("Holes counted as %d, should be 3 with buddy\n", mem_holes());
+		return 1;
+	}
+
+	myfree(a);
+	myfree(b);
+	/* a and b merge into 256 at 0, whose buddy at 256 is still split */
+	external = mem_external_fragmentation();
+	if (mem_holes() != 4 || mem_largest_free() != 512 || mem_internal_fragmentation() != 0
+		|| external < 1 - 512.0 / 960 - 1e-9 || external > 1 - 512.0 / 960 + 1e-9)
+	{
+		printf("Buddies not merged, or fragmentation misreported\n");
+		return 1;
+	}
+
+	myfree(c);
+	if (mem_holes() != 1 || mem_largest_free() != 1024 || mem_external_fragmentation() != 0)
+	{
+		printf("Buddies not merged back into the whole pool\n");
+		return 1;
+	}
+
+	/* 500 = 256 + 128 + 64 + 32 + 16 + 4, and those never merge */
+	initmem(Buddy,500);
+	if (mem_holes() != 6 || mem_largest_free() != 256 || mymalloc(257) != NULL)
+	{
+		printf("Pool of 500 bytes not split into powers of two\n");
+		return 1;
+	}
+	a = mymalloc(3);
+	b = mymalloc(256);
+	if (a != mem_pool() + 496 || b != mem_pool())
+	{
+		printf("Buddy did not take the smallest fitting block\n");
+		return 1;
+	}
+	myfree(a);
+	myfree(b);
+	if (mem_holes() != 6 || mem_free() != 500)
+	{
+		printf("Initial blocks merged with each other\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* bitmap blocks are whole 16-byte granules, taken from the lowest run of free granules that fits */
+int test_bitmap(int argc, char **argv) {
+	void *a, *b, *c;
+	void *blocks[1000];
+	int i;
+
+	initmem(Bitmap,1000);
+	a = mymalloc(100);
+	b = mymalloc(16);
+	c = mymalloc(1);
+	if (a != mem_pool() || b != a + 112 || c != a + 128)
+	{
+		printf("Bitmap blocks not rounded up to whole granules\n");
+		return 1;
+	}
+	if (mem_allocated() != 144 || mem_internal_fragmentation() != 12 + 15 || !mem_is_alloc(c + 15) || mem_is_alloc(c + 16))
+	{
+		printf("Bitmap did not count 144 bytes in granules as allocated\n");
+		return 1;
+	}
+
+	/* a 16 byte hole at 112 is passed over for 20 bytes, and then filled */
+	myfree(b);
+	if (mymalloc(20) != a + 144 || mymalloc(10) != b || mem_holes() != 1)
+	{
+		printf("Lowest fitting run of granules not taken with bitmap\n");
+		return 1;
+	}
+
+	/* 1000 = 62 granules + 8 bytes, which are free but can't be handed out */
+	initmem(Bitmap,1000);
+	if (mymalloc(993) != NULL || (a = mymalloc(992)) != mem_pool() || mem_holes() != 1 || mem_free() != 8)
+	{
+		printf("Partial granule at the end of the pool handed out\n");
+		return 1;
+	}
+	myfree(a);
+
+	/* 65536 granules, mostly looked at 64 at a time */
+	initmem(Bitmap,1 << 20);
+	for (i = 0; i < 1000; i++)
+		blocks[i] = mymalloc(48);
+	for (i = 0; i < 1000; i += 2)
+		myfree(blocks[i]);
+	for (i = 601; i < 641; i += 2)
+		myfree(blocks[i]);
+	/* 479 holes of 48 bytes, 1968 bytes from block 600 to 640, and the rest of the pool */
+	if (mem_holes() != 481 || mem_is_alloc(blocks[0]) || !mem_is_alloc(blocks[1] + 47))
+	{
+		printf("Holes counted as %d, should be 481 with bitmap\n", mem_holes());
+		return 1;
+	}
+	if (mymalloc(1968) != blocks[600] || mymalloc(1969) != blocks[999] + 48 || mem_holes() != 480)
+	{
+		printf("Long run of free granules not found with bitmap\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/* runs check on a fresh pool of size bytes for each of the flags and every strategy asked for; 1 if any case fails */
+int for_each_pool(char **argv, int *flags, int flagCount, size_t size, int (*check)(strategies strategy, int flags))
+{
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+	int f;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		for (f = 0; f < flagCount; f++)
+		{
+			initmem_flags(strategy, size, flags[f]);
+			if (check(strategy, flags[f]))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* aligned blocks start at a multiple of the alignment, and the skipped bytes before them stay free */
+int check_aligned(strategies strategy, int flags)
+{
+	size_t alignments[] = {16, 64, 4096};
+	void *pointers[3];
+	void *small;
+	int i;
+
+	small = mymalloc(3);
+	for (i = 0; i < 3; i++)
+	{
+		pointers[i] = mymalloc_aligned(alignments[i], 100);
+		if (pointers[i] == NULL || (size_t)pointers[i] % alignments[i] != 0)
+		{
+			printf("Block not aligned to %zu bytes with %s\n", alignments[i], strategy_name(strategy));
+			return 1;
+		}
+		memset(pointers[i], i, 100);
+	}
+	if (mymalloc_aligned(48, 10) != NULL)
+	{
+		printf("Alignment that is not a power of two accepted with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	if (flags == 0 && strategy != Buddy)
+	{
+		/* the 61 bytes between the small block and the 64-byte aligned one are a hole of their own;
+		   Bitmap rounds blocks up to 16-byte granules, so there it is the bytes before the 4096-byte aligned one */
+		void *aligned = strategy == Bitmap ? pointers[2] : pointers[1];
+		if (mem_allocated() != (strategy == Bitmap ? 16 + 3 * 112 : 303) || mem_is_alloc(aligned - 1) || !mem_is_alloc(aligned))
+		{
+			printf("Bytes skipped for alignment not left free with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+		myfree(pointers[i]);
+	myfree(small);
+	mem_flush_cache();
+	if (mem_allocated() != 0 || mem_free() + mem_overhead() != mem_total() || (strategy != Buddy && mem_holes() != 1))
+	{
+		printf("Aligned blocks not merged back when freed with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	return 0;
+}
+
+int test_aligned(int argc, char **argv) {
+	int flags[] = {0, MEM_BOUNDARY_TAGS, MEM_THREAD_CACHE};
+
+	return for_each_pool(argv, flags, 3, 20000, check_aligned);
+}
+
+/* blocks grow into the free space after them and shrink where they are, and only move when they must */
+int check_realloc(strategies strategy, int flags)
+{
+	unsigned char *a, *b, *c, *moved;
+	int i;
+
+	a = mymalloc(300);
+	b = mymalloc(300);
+	c = mymalloc(300);
+	memset(a, 7, 300);
+	myfree(b);
+
+	/* a can take over the free space b left */
+	if (myrealloc(a, 450) != a || myrealloc(a, 600) != a || myrealloc(a, 40) != a)
+	{
+		printf("Block not resized in place with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	if (flags == 0 && strategy != Buddy && (mem_allocated() != (strategy == Bitmap ? 48 + 304 : 340) || mem_holes() != 2))
+	{
+		printf("Resized block left %d bytes allocated in %d holes with %s\n", mem_allocated(), mem_holes(), strategy_name(strategy));
+		return 1;
+	}
+
+	/* c is in the way */
+	moved = myrealloc(a, 1100);
+	if (moved == NULL || moved == a)
+	{
+		printf("Block not moved when it could not grow with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	for (i = 0; i < 40; i++)
+	{
+		if (moved[i] != 7)
+		{
+			printf("Moved block lost its contents with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	if (myrealloc(moved, 0) != NULL || myrealloc(mem_pool() + 5000, 10) != NULL)
+	{
+		printf("Freeing or resizing a foreign block returned a block with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	a = myrealloc(NULL, 10);
+	myfree(a);
+	myfree(c);
+	mem_flush_cache();
+	if (mem_allocated() != 0 || mem_free() + mem_overhead() != mem_total())
+	{
+		printf("Resized blocks not all freed with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	return 0;
+}
+
+int test_realloc(int argc, char **argv) {
+	int flags[] = {0, MEM_BOUNDARY_TAGS, MEM_THREAD_CACHE};
+
+	return for_each_pool(argv, flags, 3, 4096, check_realloc);
+}
+
+
+/* mymalloc_batch() carves blocks back to back, myfree_batch() frees them in any order */
+int check_batch(strategies strategy, int flags)
+{
+	void *blocks[64];
+	int stride = flags == MEM_BOUNDARY_TAGS ? 48 : 32;
+	int count;
+	int i, j;
+
+	if (mymalloc_batch(32, blocks, 64) != 64)
+	{
+		printf("Batch not allocated with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	for (i = 0; i < 64; i++)
+	{
+		if (flags != MEM_THREAD_CACHE && strategy != Buddy && (char *)blocks[i] != (char *)blocks[0] + i * stride)
+		{
+			printf("Batch block %d not next to the one before with %s\n", i, strategy_name(strategy));
+			return 1;
+		}
+		memset(blocks[i], i, 32);
+	}
+	for (i = 0; i < 64; i++)
+	{
+		for (j = 0; j < 32; j++)
+		{
+			if (((unsigned char *)blocks[i])[j] != i)
+			{
+				printf("Batch blocks overlap with %s\n", strategy_name(strategy));
+				return 1;
+			}
+		}
+	}
+
+	/* every other block on its own, the rest as a batch in reverse order */
+	for (i = 0; i < 32; i++)
+	{
+		myfree(blocks[2 * i]);
+		blocks[i] = blocks[2 * i + 1];
+	}
+	for (i = 0; i < 16; i++)
+	{
+		void *swap = blocks[i];
+		blocks[i] = blocks[31 - i];
+		blocks[31 - i] = swap;
+	}
+	myfree_batch(blocks, 32);
+	mem_flush_cache();
+	if (mem_allocated() != 0 || mem_free() + mem_overhead() != mem_total() || (flags == 0 && strategy != Buddy && mem_holes() != 1))
+	{
+		printf("Batch left %d bytes allocated in %d holes with %s\n", mem_allocated(), mem_holes(), strategy_name(strategy));
+		return 1;
+	}
+
+	/* no hole for the whole batch, so only some blocks fit */
+	count = mymalloc_batch(1000, blocks, 20);
+	if (count < 1 || count >= 20 || blocks[count] != NULL || blocks[19] != NULL)
+	{
+		printf("Too large batch allocated %d blocks with %s\n", count, strategy_name(strategy));
+		return 1;
+	}
+	myfree_batch(blocks, count);
+	mem_flush_cache();
+	if (mem_allocated() != 0)
+	{
+		printf("Partial batch not freed with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	return 0;
+}
+
+int test_batch(int argc, char **argv) {
+	int flags[] = {0, MEM_BOUNDARY_TAGS, MEM_THREAD_CACHE};
+
+	return for_each_pool(argv, flags, 3, 8192, check_batch);
+}
+
+
+/* bytes of [start, start + size) in RAM; start must be page aligned */
+size_t resident_bytes(void *start, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t pages = (size + page - 1) / page;
+	unsigned char *vec = malloc(pages);
+	size_t resident = 0;
+	size_t i;
+
+	if (vec == NULL || mincore(start, size, vec) != 0)
+	{
+		free(vec);
+		return (size_t)-1;
+	}
+	for (i = 0; i < pages; i++)
+		resident += (vec[i] & 1) * page;
+	free(vec);
+	return resident;
+}
+
+/* 1 if the mapping holding addr asks for transparent huge pages, 0 if not, -1 if /proc/self/smaps can't tell */
+int huge_pages_advised(void *addr)
+{
+	FILE *smaps = fopen("/proc/self/smaps", "r");
+	char line[512];
+	unsigned long start, end;
+	int inside = 0;
+	int advised = -1;
+
+	if (smaps == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), smaps) != NULL)
+	{
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' '))
+			inside = (unsigned long)addr >= start && (unsigned long)addr < end;
+		else if (inside && strncmp(line, "VmFlags:", 8) == 0)
+		{
+			advised = strstr(line, " hg") != NULL;
+			break;
+		}
+	}
+	fclose(smaps);
+	return advised;
+}
+
+/* MEM_MMAP pools commit pages when touched and give them back when large holes are freed */
+int check_mmap(strategies strategy, int flags)
+{
+	size_t size = mem_total();
+	unsigned char *a, *b;
+	int i;
+
+	if (flags != MEM_HUGE_PAGES && resident_bytes(mem_pool(), size) > 64 * 1024)
+	{
+		printf("New pool already committed %zu bytes with %s\n", resident_bytes(mem_pool(), size), strategy_name(strategy));
+		return 1;
+	}
+	a = mymalloc(4 << 20);
+	b = mymalloc(100);
+	if (a == NULL || b == NULL)
+	{
+		printf("Mapped pool did not allocate with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	memset(a, 1, 4 << 20);
+	memset(b, 7, 100);
+	if (flags != MEM_HUGE_PAGES && resident_bytes(mem_pool(), size) < (4 << 20))
+	{
+		printf("Touched block not resident with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	myfree(a);
+	if (flags != MEM_HUGE_PAGES && resident_bytes(mem_pool(), size) > 256 * 1024)
+	{
+		printf("Freed block still has %zu bytes resident with %s\n", resident_bytes(mem_pool(), size), strategy_name(strategy));
+		return 1;
+	}
+	/* b shares a page with the hole, which must not be released */
+	for (i = 0; i < 100; i++)
+	{
+		if (b[i] != 7)
+		{
+			printf("Block next to a released hole lost its contents with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	/* released pages come back when allocated again */
+	a = mymalloc(4 << 20);
+	if (a == NULL)
+	{
+		printf("Released hole not allocated again with %s\n", strategy_name(strategy));
+		return 1;
+	}
+	memset(a, 2, 4 << 20);
+	myfree(a);
+	myfree(b);
+	if (mem_allocated() != 0 || mem_free() + mem_overhead() != mem_total())
+	{
+		printf("Mapped pool not all freed with %s\n", strategy_name(strategy));
+		return 1;
+	}
+
+	return 0;
+}
+
+int test_mmap(int argc, char **argv) {
+	int flags[] = {MEM_MMAP, MEM_MMAP | MEM_BOUNDARY_TAGS, MEM_HUGE_PAGES};
+
+	return for_each_pool(argv, flags, 3, 8 << 20, check_mmap);
+}
+
+
+/* MEM_GROWABLE pools commit more memory when full and mem_trim() gives the free tail back */
+int check_growable(strategies strategy, int flags)
+{
+	unsigned char *blocks[100];
+	unsigned char *aligned;
+	int i, j;
+
+	for (i = 0; i < 100; i++)
+	{
+		blocks[i] = mymalloc(1000);
+		if (blocks[i] == NULL)
+		{
+			printf("Growable pool full after %d blocks with %s\n", i, strategy_name(strategy));
+			return 1;
+		}
+		memset(blocks[i], i, 1000);
+	}
+	aligned = mymalloc_aligned(65536, 5000);
+	if (aligned == NULL || (uintptr_t)aligned % 65536 != 0 || mem_total() < 105000)
+	{
+		printf("Growable pool did not grow to %d bytes with %s\n", mem_total(), strategy_name(strategy));
+		return 1;
+	}
+	for (i = 0; i < 100; i++)
+	{
+		for (j = 0; j < 1000; j++)
+		{
+			if (blocks[i][j] != i)
+			{
+				printf("Blocks of a growing pool overlap with %s\n", strategy_name(strategy));
+				return 1;
+			}
+		}
+	}
+
+	/* the tail after the last block is trimmed, the block keeps its contents */
+	myfree(aligned);
+	for (i = 1; i < 100; i++)
+		myfree(blocks[i]);
+	mem_flush_cache();
+	if (mem_trim() == 0 || mem_total() > 8192 || blocks[0][999] != 0)
+	{
+		printf("Growable pool trimmed to %d bytes with %s\n", mem_total(), strategy_name(strategy));
+		return 1;
+	}
+	myfree(blocks[0]);
+	mem_flush_cache();
+	mem_trim();
+	if (mem_allocated() != 0 || mem_total() != 4096 || mem_free() + mem_overhead() != mem_total())
+	{
+		printf("Trimmed pool is %d bytes with %d allocated with %s\n", mem_total(), mem_allocated(), strategy_name(strategy));
+		return 1;
+	}
+
+	/* and grows again */
+	for (i = 0; i < 100; i++)
+	{
+		if ((blocks[i] = mymalloc(1000)) == NULL)
+		{
+			printf("Trimmed pool did not grow again with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	/* trimming whole huge pages maps them again, still asking for huge pages */
+	if (flags & MEM_HUGE_PAGES)
+	{
+		myfree(mymalloc(4 << 20));
+		if (mem_trim() == 0 || huge_pages_advised((char *)mem_pool() + (4 << 20)) == 0)
+		{
+			printf("Trimmed huge pages no longer asked for with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int test_growable(int argc, char **argv) {
+	int flags[] = {MEM_GROWABLE, MEM_GROWABLE | MEM_BOUNDARY_TAGS, MEM_GROWABLE | MEM_THREAD_CACHE, MEM_GROWABLE | MEM_HUGE_PAGES};
+
+	return for_each_pool(argv, flags, 4, 4096, check_growable);
+}
+
+
+/* links count blocks of a pool file, each holding the offset of the next and its index, from the root */
+int pool_file_list(int count)
+{
+	size_t *block = mem_root();
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (block == NULL || block[1] != (size_t)i)
+			return 0;
+		block = block[0] ? (size_t *)((char *)mem_pool() + block[0]) : NULL;
+	}
+	return block == NULL;
+}
+
+int pool_file_build(int count)
+{
+	size_t *last = NULL;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		size_t *block = mymalloc(2 * sizeof(size_t));
+		if (block == NULL)
+			return 0;
+		block[0] = 0;
+		block[1] = i;
+		if (last == NULL)
+			mem_set_root(block);
+		else
+			last[0] = (char *)block - (char *)mem_pool();
+		last = block;
+	}
+	return 1;
+}
+
+/* bytes of address space the process has mapped */
+size_t mapped_bytes(void)
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0;
+
+	if (statm != NULL)
+	{
+		if (fscanf(statm, "%lu", &pages) != 1)
+			pages = 0;
+		fclose(statm);
+	}
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+/* initmem_file() reopens a pool with its blocks and data, also after a crash */
+int test_pool_file(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+	const char *path = "test.pool";
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		int allocated, holes;
+		pid_t child;
+		FILE *other;
+		struct rlimit limit, tight;
+		struct stat status;
+		int opened;
+
+		unlink(path);
+		if (initmem_file(path, strategy, 1 << 16) != 0 || !pool_file_build(100))
+		{
+			printf("Pool file not created with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree(mymalloc(500)); /* leaves a hole among the blocks */
+		allocated = mem_allocated();
+		holes = mem_holes();
+		if (mem_pool_open_file(path, strategy, 0, NULL) != NULL)
+		{
+			printf("Pool file opened while another pool has it open with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* closed cleanly by the next initmem() */
+		initmem(strategy, 4096);
+		if (initmem_file(path, strategy, 1234) != 1 || mem_total() != 1 << 16 || mem_allocated() != allocated
+			|| mem_holes() != holes || !pool_file_list(100))
+		{
+			printf("Pool file not reopened as it was closed with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* a process that dies without closing the file, after breaking the free list
+		   (its head is the first word of a boundary tag pool) */
+		initmem(strategy, 4096);
+		child = fork();
+		if (child == 0)
+		{
+			initmem_file(path, strategy, 0);
+			mymalloc(100);
+			*(size_t *)mem_pool() = 12345;
+			_exit(0);
+		}
+		waitpid(child, NULL, 0);
+		if (initmem_file(path, strategy, 0) != 1 || mem_allocated() != allocated + 112
+			|| mem_holes() != holes || !pool_file_list(100))
+		{
+			printf("Pool file not recovered after a crash with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (mymalloc(20000) == NULL || !pool_file_list(100))
+		{
+			printf("Recovered pool file does not allocate with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* not a pool file */
+		initmem(strategy, 4096);
+		other = fopen(path, "w");
+		fputs("not a pool", other);
+		fclose(other);
+		if (initmem_file(path, strategy, 4096) != -1)
+		{
+			printf("Foreign file opened as a pool with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* a new file that can't be mapped is cut back to empty, so the next open creates the pool */
+		initmem(strategy, 4096);
+		unlink(path);
+		getrlimit(RLIMIT_AS, &limit);
+		tight = limit;
+		tight.rlim_cur = mapped_bytes() + (64 << 20);
+		setrlimit(RLIMIT_AS, &tight);
+		opened = initmem_file(path, strategy, (size_t)1 << 30);
+		setrlimit(RLIMIT_AS, &limit);
+		if (opened != -1 || stat(path, &status) != 0 || status.st_size != 0)
+		{
+			printf("Pool file that could not be mapped left at %ld bytes with %s\n", (long)status.st_size, strategy_name(strategy));
+			return 1;
+		}
+		if (initmem_file(path, strategy, 4096) != 0 || mymalloc(100) == NULL)
+		{
+			printf("Pool file not created after a failed open with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		initmem(strategy, 4096);
+		unlink(path);
+	}
+
+	return 0;
+}
+
+
+/* first and next fit scan only the free blocks; next fit comes back round to the block it last allocated from */
+int test_free_list(int argc, char **argv) {
+	strategies strategies[] = {First, Next};
+	int s;
+
+	for (s = 0; s < 2; s++)
+	{
+		void *blocks[50];
+		void *first, *again;
+		int i;
+
+		initmem(strategies[s], 300);
+		first = mymalloc(100);
+		mymalloc(100);
+		mymalloc(100);
+		myfree(first);
+		again = mymalloc(100);
+		myfree(again);
+		if (mymalloc(100) != first)
+		{
+			printf("Only free block not found with %s\n", strategy_name(strategies[s]));
+			return 1;
+		}
+
+		initmem(strategies[s], 5000);
+		for (i = 0; i < 50; i++)
+			blocks[i] = mymalloc(100);
+		for (i = 49; i >= 0; i -= 7)
+			myfree(blocks[i]);
+		if (mem_largest_free() != 100)
+		{
+			printf("Largest free block is %d with %s\n", mem_largest_free(), strategy_name(strategies[s]));
+			return 1;
+		}
+		for (i = 49 % 7; i < 50; i += 7)
+		{
+			if (mymalloc(100) != blocks[i])
+			{
+				printf("Holes not reused in address order with %s\n", strategy_name(strategies[s]));
+				return 1;
+			}
+		}
+		if (mem_holes() != 0)
+		{
+			printf("%d holes left with %s\n", mem_holes(), strategy_name(strategies[s]));
+			return 1;
+		}
+
+		/* the lowest hole that fits, past a smaller one */
+		myfree(blocks[3]);
+		for (i = 30; i < 33; i++)
+			myfree(blocks[i]);
+		for (i = 40; i < 44; i++)
+			myfree(blocks[i]);
+		if (mem_largest_free() != 400 || (strategies[s] == First && mymalloc(250) != blocks[30]))
+		{
+			printf("Lowest fitting hole not found with %s\n", strategy_name(strategies[s]));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* small blocks come from slabs of their size class, which go back to the pool once empty */
+int test_slabs(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		unsigned char *blocks[253];
+		unsigned char *moved, *other;
+		int i;
+
+		initmem_flags(strategy, 1 << 16, MEM_SMALL_SLABS);
+		for (i = 0; i < 252; i++)
+		{
+			blocks[i] = mymalloc(1 + i % 16);
+			if (blocks[i] == NULL || (size_t)blocks[i] % 16 != 0)
+			{
+				printf("Small block %d not allocated with %s\n", i, strategy_name(strategy));
+				return 1;
+			}
+			memset(blocks[i], i, 1 + i % 16);
+		}
+		if (mem_allocated() != 4096)
+		{
+			printf("252 small blocks take %d bytes with %s\n", mem_allocated(), strategy_name(strategy));
+			return 1;
+		}
+		for (i = 0; i < 252; i++)
+		{
+			if (!mem_is_alloc(blocks[i]) || blocks[i][i % 16] != (unsigned char)i)
+			{
+				printf("Small block %d overwritten with %s\n", i, strategy_name(strategy));
+				return 1;
+			}
+		}
+
+		/* resizing stays in the slot up to its class */
+		if (myrealloc(blocks[0], 16) != blocks[0])
+		{
+			printf("Small block moved within its class with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		moved = myrealloc(blocks[1], 300);
+		if (moved == NULL || moved == blocks[1] || moved[1] != 1 || mem_is_alloc(blocks[1]))
+		{
+			printf("Small block not moved out of its class with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree(moved);
+		if (mymalloc(16) != blocks[1])
+		{
+			printf("Freed slot not reused with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* a second slab, emptied, is only kept while the first is full */
+		blocks[252] = mymalloc(16);
+		other = mymalloc(200);
+		if (mem_allocated() != 3 * 4096)
+		{
+			printf("Three slabs take %d bytes with %s\n", mem_allocated(), strategy_name(strategy));
+			return 1;
+		}
+		myfree(blocks[252]);
+		myfree(other);
+		if (mem_allocated() != 3 * 4096)
+		{
+			printf("Only empty slabs of their class given back with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree(blocks[7]);
+		if (mem_allocated() != 2 * 4096)
+		{
+			printf("Empty slab kept next to one with room with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		for (i = 0; i < 252; i++)
+		{
+			if (i != 7)
+				myfree(blocks[i]);
+		}
+		mem_flush_cache();
+		if (mem_allocated() != 0 || mem_holes() != 1)
+		{
+			printf("%d bytes in %d holes left after freeing with %s\n", mem_allocated(), mem_holes(), strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* mem_compact() slides handle blocks together in slices, around blocks that can't move */
+int test_compact(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		mem_handle_t handles[50];
+		mem_handle_t large;
+		void *pinned;
+		void *before[50];
+		size_t moved;
+		int largest, more, slices = 0;
+		int i, j;
+
+		initmem(strategy, 10000);
+		for (i = 0; i < 50; i++)
+		{
+			handles[i] = mymalloc_handle(100 + i);
+			if (handles[i] == 0)
+			{
+				printf("Handle not allocated with %s\n", strategy_name(strategy));
+				return 1;
+			}
+			memset(mem_deref(handles[i]), i, 100 + i);
+			if (i == 24)
+				pinned = mymalloc(10);
+		}
+		for (i = 0; i < 50; i += 2)
+		{
+			myfree_handle(handles[i]);
+			if (mem_deref(handles[i]) != NULL)
+			{
+				printf("Freed handle still has a block with %s\n", strategy_name(strategy));
+				return 1;
+			}
+		}
+		largest = mem_largest_free();
+
+		/* each call moves at most its budget */
+		do
+		{
+			for (i = 1; i < 50; i += 2)
+				before[i] = mem_deref(handles[i]);
+			more = mem_compact(1000);
+			moved = 0;
+			for (i = 1; i < 50; i += 2)
+			{
+				if (mem_deref(handles[i]) != before[i])
+					moved += 100 + i;
+			}
+			if (moved > 1000)
+			{
+				printf("Compaction moved %zu bytes on a budget of 1000 with %s\n", moved, strategy_name(strategy));
+				return 1;
+			}
+			slices += more;
+		} while (more);
+		if (strategy != Buddy && (slices < 2 || mem_holes() != 2 || mem_largest_free() <= largest))
+		{
+			printf("Compacted in %d slices to %d holes with %s\n", slices, mem_holes(), strategy_name(strategy));
+			return 1;
+		}
+		for (i = 1; i < 50; i += 2)
+		{
+			unsigned char *block = mem_deref(handles[i]);
+			for (j = 0; j < 100 + i; j++)
+			{
+				if (block[j] != i)
+				{
+					printf("Moved block lost its contents with %s\n", strategy_name(strategy));
+					return 1;
+				}
+			}
+		}
+
+		/* a handle block can't be freed as a pointer, and handles are reused */
+		myfree(mem_deref(handles[1]));
+		myfree_handle(handles[1]);
+		if (mymalloc_handle(10) != handles[1])
+		{
+			printf("Handle not reused with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree_handle(handles[1]);
+		for (i = 3; i < 50; i += 2)
+			myfree_handle(handles[i]);
+		myfree(pinned);
+		if (mem_allocated() != 0 || mem_compact(1000) != 0)
+		{
+			printf("Handle blocks not all freed with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* handle blocks skip the thread caches, so realloc must not look for a cache header in front of them */
+		initmem_flags(strategy, 4096, MEM_THREAD_CACHE);
+		handles[0] = mymalloc_handle(32);
+		handles[1] = mymalloc_handle(32);
+		memset(mem_deref(handles[0]), 0, 32);
+		before[0] = mem_deref(handles[1]);
+		before[1] = myrealloc(before[0], 200);
+		if ((before[1] != NULL && before[1] != before[0]) || mem_deref(handles[1]) != before[0] || !mem_is_alloc(before[0])
+			|| mymalloc(16) == before[0] || myrealloc(before[0], 5000) != NULL || mem_deref(handles[1]) != before[0])
+		{
+			printf("Handle block moved by realloc with thread caches with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		if (strategy == Buddy)
+			continue; /* nothing to compact */
+
+		/* a block larger than the budget is never moved, and realloc can't move a handle block either */
+		initmem(strategy, 1 << 20);
+		handles[0] = mymalloc_handle(1000);
+		large = mymalloc_handle(300000);
+		pinned = mymalloc(10);
+		myfree_handle(handles[0]);
+		before[0] = mem_deref(large);
+		while (mem_compact(4096))
+			;
+		if (mem_deref(large) != before[0])
+		{
+			printf("Block larger than the budget moved with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		while (mem_compact(1 << 20))
+			;
+		if (mem_deref(large) == before[0])
+		{
+			printf("Block not moved with budget to spare with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		before[0] = mem_deref(large);
+		if (myrealloc(before[0], 400000) != NULL || mem_deref(large) != before[0] || !mem_is_alloc(before[0]))
+		{
+			printf("Handle block moved by realloc with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree_handle(large);
+		myfree(pinned);
+		if (mem_allocated() != 0)
+		{
+			printf("Large handle block not freed with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* boundary tag mode: block layout, coalescing, and a randomized run that checks no two blocks overlap */
+int test_boundary_tags(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		void *pointers[100];
+		int sizes[100];
+		int stored = 0;
+		void *first;
+		void *second;
+		int i;
+
+		initmem_flags(strategy,1000,MEM_BOUNDARY_TAGS);
+
+		if (mem_holes() != 1 || mem_allocated() != 0 || mem_allocated() + mem_free() + mem_overhead() != mem_total())
+		{
+			printf("Fresh tagged pool reported wrong with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* a 1 byte block takes the minimum of 32 bytes: 16 of tags and 16 of payload */
+		first = mymalloc(1);
+		second = mymalloc(1);
+		if (second != first + 32 || ((size_t)first) % 16 != 0 || mem_allocated() != 32)
+		{
+			printf("Tagged blocks not laid out as 32 byte, 16-byte aligned blocks with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (!mem_is_alloc(first) || !mem_is_alloc(first + 15) || mem_is_alloc(second + 40))
+		{
+			printf("Tagged pool reports the wrong bytes as allocated with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		myfree(first);
+		myfree(second);
+		if (mem_holes() != 1 || mem_allocated() != 0 || mem_largest_free() != mem_free())
+		{
+			printf("Tagged blocks not coalesced with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		/* random allocations and frees; every block is filled with its own byte and checked when freed */
+		srand(strategy);
+		for (i = 0; i < 5000; i++)
+		{
+			if (stored < 100 && rand() % 2)
+			{
+				int size = rand() % 60 + 1;
+				void *pointer = mymalloc(size);
+				if (pointer == NULL)
+					continue;
+				memset(pointer, stored, size);
+				pointers[stored] = pointer;
+				sizes[stored] = size;
+				stored++;
+			}
+			else if (stored > 0)
+			{
+				int chosen = rand() % stored;
+				int j;
+				for (j = 0; j < sizes[chosen]; j++)
+				{
+					if (((unsigned char *)pointers[chosen])[j] != (unsigned char)chosen)
+					{
+						printf("Tagged block overwritten with %s\n", strategy_name(strategy));
+						return 1;
+					}
+				}
+				myfree(pointers[chosen]);
+				stored--;
+				if (chosen != stored)
+				{
+					pointers[chosen] = pointers[stored];
+					sizes[chosen] = sizes[stored];
+					memset(pointers[chosen], chosen, sizes[chosen]);
+				}
+			}
+			if (mem_allocated() + mem_free() + mem_overhead() != mem_total())
+			{
+				printf("Tagged pool totals don't add up with %s\n", strategy_name(strategy));
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* two pools in use at once must not see each other's blocks or statistics */
+int test_pools(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		strategies other = strategy % NUM_STRATEGIES + 1;
+		int size = block_size(strategy, 100);
+		/* 512 bytes, so that Buddy has a single block to merge back into */
+		mem_pool_t *a = mem_pool_create(strategy, 512, 0);
+		mem_pool_t *b = mem_pool_create(other, 1000, MEM_BOUNDARY_TAGS);
+		void *inA;
+		void *inB;
+
+		if (a == NULL || b == NULL)
+		{
+			printf("Could not create pools with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		inA = mem_pool_malloc(a, 100);
+		inB = mem_pool_malloc(b, 200);
+		if (inA != mem_pool_base(a) || mem_pool_allocated(a) != size || mem_pool_free_bytes(a) != 512 - size || mem_pool_total(a) != 512)
+		{
+			printf("Pool statistics wrong with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (mem_pool_allocated(b) < 200 || mem_pool_total(b) != 1000 || mem_pool_holes(b) != 1)
+		{
+			printf("Tagged pool statistics wrong alongside %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (!mem_pool_is_alloc(a, inA) || mem_pool_is_alloc(a, inB) || !mem_pool_is_alloc(b, inB) || mem_pool_is_alloc(b, inA))
+		{
+			printf("Pools answer for each other's blocks with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		mem_pool_free(a, inA);
+		if (mem_pool_allocated(a) != 0 || mem_pool_holes(a) != 1 || mem_pool_allocated(b) < 200)
+		{
+			printf("Freeing in one pool affected the other with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		mem_pool_free(b, inB);
+		mem_pool_destroy(a);
+		mem_pool_destroy(b);
+	}
+
+	return 0;
+}
+
+/* thread caches hand freed blocks back out, and give them back to the pool when flushed or when their thread exits */
+int test_thread_cache(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		int flags[] = {MEM_THREAD_CACHE, MEM_THREAD_CACHE | MEM_BOUNDARY_TAGS};
+		int f;
+
+		for (f = 0; f < 2; f++)
+		{
+			void *first;
+			void *again;
+			void *large;
+			void *blocks[40];
+			int i;
+
+			/* 4096 bytes, so that Buddy has a single block to merge back into */
+			initmem_flags(strategy, 4096, flags[f]);
+			first = mymalloc(10);
+			myfree(first);
+			again = mymalloc(16);
+			if (again != first)
+			{
+				printf("Freed block not reused from the thread cache with %s\n", strategy_name(strategy));
+				return 1;
+			}
+			large = mymalloc(1000);
+			if (large == NULL || !mem_is_alloc(large))
+			{
+				printf("Large block not allocated past the thread cache with %s\n", strategy_name(strategy));
+				return 1;
+			}
+			myfree(large);
+			myfree(again);
+			mem_flush_cache();
+			if (mem_allocated() != 0 || mem_holes() != 1)
+			{
+				printf("Flushed thread cache left blocks allocated with %s\n", strategy_name(strategy));
+				return 1;
+			}
+
+			/* threads exiting must give their cached blocks back */
+			if (run_threads(4, 2000) < 0)
+			{
+				printf("Block overwritten by another thread with %s\n", strategy_name(strategy));
+				return 1;
+			}
+			if (mem_allocated() != 0 || mem_holes() != 1)
+			{
+				printf("Exited threads left blocks allocated with %s\n", strategy_name(strategy));
+				return 1;
+			}
+
+			/* the headers in front of the blocks are read as size_t, so every block is 16-byte aligned */
+			initmem_flags(strategy, 1 << 16, flags[f]);
+			for (i = 0; i < 40; i++)
+			{
+				blocks[i] = mymalloc(1 + i * 13 % 300);
+				if (blocks[i] == NULL || (size_t)blocks[i] % 16 != 0)
+				{
+					printf("Cached block not 16-byte aligned with %s\n", strategy_name(strategy));
+					return 1;
+				}
+			}
+			for (i = 0; i < 40; i++)
+				myfree(blocks[i]);
+		}
+	}
+
+	return 0;
+}
+
+/* an arena pool falls back to the other arenas when one is full, and frees to the arena that owns the block */
+int test_arenas(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		void *pointers[4];
+		int size = block_size(strategy, 1000);
+		int i, j;
+
+		initmem_arenas(strategy, 4096, 0, 4);
+		for (i = 0; i < 4; i++)
+		{
+			pointers[i] = mymalloc(1000);
+			if (pointers[i] == NULL)
+			{
+				printf("Allocation %d did not fall back to another arena with %s\n", i, strategy_name(strategy));
+				return 1;
+			}
+			for (j = 0; j < i; j++)
+			{
+				if ((pointers[i] - mem_pool()) / 1024 == (pointers[j] - mem_pool()) / 1024)
+				{
+					printf("Two 1000 byte blocks placed in one 1024 byte arena with %s\n", strategy_name(strategy));
+					return 1;
+				}
+			}
+		}
+		/* what each block leaves of its arena: 24 bytes, 16 with Bitmap, none with Buddy */
+		if (mymalloc(1000) != NULL || mem_allocated() != 4 * size || mem_holes() != (size < 1024 ? 4 : 0) || mem_largest_free() != 1024 - size)
+		{
+			printf("Full arenas reported wrong with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		for (i = 0; i < 4; i++)
+		{
+			if (!mem_is_alloc(pointers[i] + 999))
+			{
+				printf("Block in arena not reported allocated with %s\n", strategy_name(strategy));
+				return 1;
+			}
+			myfree(pointers[i]);
+		}
+		if (mem_allocated() != 0 || mem_free() != 4096 || mem_largest_free() != 1024)
+		{
+			printf("Blocks not freed to their arenas with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		initmem_arenas(strategy, 1 << 16, 0, 4);
+		if (run_threads(8, 2000) < 0 || mem_allocated() != 0)
+		{
+			printf("Threads sharing arenas corrupted blocks with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void *do_free_block(void *block)
+{
+	myfree(block);
+	return NULL;
+}
+
+/* a block freed by a thread of another arena is given back when its own arena next allocates */
+int test_remote_free(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		pthread_t freeing;
+		void *first;
+		void *second;
+		void *third;
+		void *again;
+		int size = block_size(strategy, sizeof(void *));
+		int large = block_size(strategy, 104); /* 100 bytes rounded up to a pointer */
+
+		initmem_arenas(strategy, 4096, MEM_REMOTE_FREE, 2);
+		first = mymalloc(1);
+		second = mymalloc(100);
+		/* Buddy puts the 128 byte block at a multiple of 128 */
+		if (second != first + (strategy == Buddy ? 128 : size) || mem_allocated() != size + large)
+		{
+			printf("Remote free mode did not round a block up to a pointer with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		/* the link is stored in the first word of a freed block, so blocks start pointer-aligned */
+		third = mymalloc(3);
+		if (third == NULL || (size_t)third % sizeof(void *) != 0)
+		{
+			printf("Remote free mode did not align a block to a pointer with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		myfree(third);
+
+		pthread_create(&freeing, NULL, do_free_block, first);
+		pthread_join(freeing, NULL);
+		again = mymalloc(1);
+		if (mem_allocated() != size + large || ((strategy == Best || strategy == First) && again != first))
+		{
+			printf("Remotely freed block not reused by its arena with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		pthread_create(&freeing, NULL, do_free_block, second);
+		pthread_join(freeing, NULL);
+		myfree(again);
+		if (mem_allocated() != 0 || mem_holes() != 2 || mem_largest_free() != 2048)
+		{
+			printf("Remotely freed blocks not coalesced with %s\n", strategy_name(strategy));
+			return 1;
+		}
+
+		if (producer_consumer_rate(strategy, MEM_REMOTE_FREE, 3, 20000) < 0)
+		{
+			printf("Block lost or overwritten between threads with %s\n", strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Returns the elapsed time between two timestamps in nanoseconds */
+double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/* nanoseconds per mem_is_alloc() on a random byte of one of n blocks, the best of three rounds */
+double lookup_ns(strategies strategy, int n)
+{
+	void **pointers = malloc(n * sizeof(void *));
+	double best = 0;
+	int round, i;
+
+	initmem(strategy, (size_t)n * 32);
+	for (i = 0; i < n; i++)
+		pointers[i] = mymalloc(16);
+	srand(n);
+	for (round = 0; round < 3; round++)
+	{
+		struct timespec execstart, execend;
+		int found = 0;
+		double ns;
+
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		for (i = 0; i < 20000; i++)
+			found += mem_is_alloc((char *)pointers[rand() % n] + 5);
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		ns = elapsed_ns(&execstart, &execend) / 20000;
+		if (found != 20000)
+			ns = -1;
+		if (round == 0 || ns < best)
+			best = ns;
+	}
+	free(pointers);
+	return best;
+}
+
+/* mem_is_alloc() costs O(log n) or less with every strategy: 200 times the blocks may not make it 20 times slower */
+int test_lookup_cost(int argc, char **argv) {
+	strategies strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		double few = lookup_ns(strategy, 100);
+		double many = lookup_ns(strategy, 20000);
+
+		if (few < 0 || many < 0)
+		{
+			printf("Allocated byte not found with %s\n", strategy_name(strategy));
+			return 1;
+		}
+		if (many > 20 * few + 50)
+		{
+			printf("Lookup took %.1f ns among 100 blocks and %.1f ns among 20000 with %s\n", few, many, strategy_name(strategy));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* measures the average latency of myfree() as the number of live blocks grows from 1k to 1M.
+	Blocks are allocated back to back with next fit (constant time per block) and freed in random order.
+	Results are appended to "bench.log". */
+int bench_free(int argc, char **argv)
+{
+	int counts[] = {1000, 10000, 100000, 1000000};
+	int blockSize = 16;
+	int c;
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Free latency: %d byte blocks freed in random order\n",blockSize);
+
+	for (c = 0; c < sizeof(counts)/sizeof(counts[0]); c++)
+	{
+		int n = counts[c];
+		void **pointers = malloc(n * sizeof(void *));
+		struct timespec execstart, execend;
+		int i;
+
+		initmem(Next, (size_t)n * blockSize);
+		for (i = 0; i < n; i++)
+		{
+			pointers[i] = mymalloc(blockSize);
+			if (pointers[i] == NULL)
+			{
+				printf("Allocation %d of %d failed\n", i, n);
+				return 1;
+			}
+		}
+
+		srand(n);
+		for (i = n - 1; i > 0; i--)
+		{
+			int j = rand() % (i + 1);
+			void *tmp = pointers[i];
+			pointers[i] = pointers[j];
+			pointers[j] = tmp;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		for (i = 0; i < n; i++)
+			myfree(pointers[i]);
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+
+		if (mem_holes() != 1 || mem_free() != n * blockSize)
+		{
+			printf("Memory not fully coalesced after %d frees\n", n);
+			return 1;
+		}
+
+		fprintf(log,"\t%8d blocks: %.1f ns per free\n", n, elapsed_ns(&execstart, &execend) / n);
+		free(pointers);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+
+/* mixed alloc/free throughput in alloc/free operations per second.
+	Keeps about "live" blocks of 16 to 256 bytes allocated and replaces a random one on every step. */
+double ops_per_second(int strategy, int flags, int live, int operations)
+{
+	void **pointers = malloc(live * sizeof(void *));
+	struct timespec execstart, execend;
+	int i;
+
+	srand(1);
+	initmem_flags(strategy, (size_t)live * 256 * 2, flags);
+	for (i = 0; i < live; i++)
+		pointers[i] = mymalloc(16 + rand() % 241);
+
+	clock_gettime(CLOCK_MONOTONIC, &execstart);
+	for (i = 0; i < operations; i++)
+	{
+		int chosen = rand() % live;
+		myfree(pointers[chosen]);
+		pointers[chosen] = mymalloc(16 + rand() % 241);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &execend);
+
+	free(pointers);
+	return 2 * operations / (elapsed_ns(&execstart, &execend) / 1e9);
+}
+
+/* measures mixed alloc/free throughput with many live blocks, with list nodes, with boundary tags and with small slabs.
+	Results are appended to "bench.log". */
+int bench_ops(int argc, char **argv)
+{
+	int live = 5000;
+	int operations = 50000;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Throughput: %d live blocks of 16 to 256 bytes, %d alloc/free pairs\n",live,operations);
+	fprintf(log,"\t%-6s %16s %16s %16s\n", "", "list nodes", "boundary tags", "small slabs");
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		double list = ops_per_second(strategy, 0, live, operations);
+		double tags = ops_per_second(strategy, MEM_BOUNDARY_TAGS, live, operations);
+		double slabs = ops_per_second(strategy, MEM_SMALL_SLABS, live, operations);
+		fprintf(log,"\t%-6s %8.0f ops/sec %8.0f ops/sec %8.0f ops/sec\n", strategy_name(strategy), list, tags, slabs);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* measures how much of a 1MB pool can be handed out in blocks of a fixed size, with list nodes and with boundary tags.
+	List nodes live outside the pool and are not counted. Results are appended to "bench.log". */
+int bench_capacity(int argc, char **argv)
+{
+	int sizes[] = {1, 16, 64, 256, 4096};
+	int total = 1 << 20;
+	int c;
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Capacity: %d byte pool filled with equal blocks\n",total);
+
+	for (c = 0; c < sizeof(sizes)/sizeof(sizes[0]); c++)
+	{
+		int flags[] = {0, MEM_BOUNDARY_TAGS};
+		int blocks[2];
+		int f;
+
+		for (f = 0; f < 2; f++)
+		{
+			initmem_flags(Next, total, flags[f]);
+			blocks[f] = 0;
+			while (mymalloc(sizes[c]) != NULL)
+				blocks[f]++;
+		}
+		fprintf(log,"\t%5d byte blocks: list %7d blocks (%5.1f%% of pool), tags %7d blocks (%5.1f%% of pool)\n",
+			sizes[c], blocks[0], 100.0 * blocks[0] * sizes[c] / total, blocks[1], 100.0 * blocks[1] * sizes[c] / total);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* measures a pipeline where one thread allocates and 1 to 8 others free, with locked and with remote frees.
+	Results are appended to "bench.log". */
+int bench_remote_free(int argc, char **argv)
+{
+	int consumerCounts[] = {1, 2, 4, 8};
+	int blocks = 100000;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+	int c;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Producer/consumer: 1 producer, %d blocks of 16 to 256 bytes freed by the consumers\n",blocks);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		fprintf(log,"\t=== %s ===\n",strategy_name(strategy));
+		for (c = 0; c < sizeof(consumerCounts)/sizeof(consumerCounts[0]); c++)
+		{
+			double locked = producer_consumer_rate(strategy, 0, consumerCounts[c], blocks);
+			double remote = producer_consumer_rate(strategy, MEM_REMOTE_FREE, consumerCounts[c], blocks);
+			if (locked < 0 || remote < 0)
+			{
+				printf("Block lost or overwritten between threads with %s\n", strategy_name(strategy));
+				fclose(log);
+				return 1;
+			}
+			fprintf(log,"\t%d consumers: %10.0f blocks/sec locked free, %10.0f blocks/sec remote free\n",consumerCounts[c],locked,remote);
+		}
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* measures growing a buffer 16 bytes at a time up to 256KB, with myrealloc() and with mymalloc() + copy + myfree().
+	Results are appended to "bench.log". */
+int bench_realloc(int argc, char **argv)
+{
+	int total = 1 << 18;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Growing one buffer by 16 bytes up to %d bytes\n",total);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		struct timespec execstart, execend;
+		double grown, copied;
+		char *buffer;
+		int moves = 0;
+		int size;
+
+		initmem(strategy, 4 * total);
+		buffer = mymalloc(16);
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		for (size = 32; size <= total; size += 16)
+		{
+			char *next = myrealloc(buffer, size);
+			moves += next != buffer;
+			buffer = next;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		grown = elapsed_ns(&execstart, &execend);
+
+		initmem(strategy, 4 * total);
+		buffer = mymalloc(16);
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		for (size = 32; size <= total; size += 16)
+		{
+			char *next = mymalloc(size);
+			memcpy(next, buffer, size - 16);
+			myfree(buffer);
+			buffer = next;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		copied = elapsed_ns(&execstart, &execend);
+
+		fprintf(log,"\t%-6s myrealloc %8.2fms (%d moves), malloc+copy+free %8.2fms\n", strategy_name(strategy), grown / 1e6, moves, copied / 1e6);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* Allocates and frees groups of blocks between long-lived ones, one at a time and as batches */
+int bench_batch(int argc, char **argv)
+{
+	int rounds = 200;
+	int group = 1024;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"%d rounds of %d blocks of 64 bytes among 2048 live blocks\n",rounds,group);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		struct timespec execstart, execend;
+		double single, batched;
+		void **live = malloc(2048 * sizeof(void *));
+		void **blocks = malloc(group * sizeof(void *));
+		int round, i, pass;
+
+		for (pass = 0; pass < 2; pass++)
+		{
+			initmem(strategy, 1 << 20);
+			/* holes too small for the groups all along the pool */
+			for (i = 0; i < 2048; i++)
+				live[i] = mymalloc(128);
+			for (i = 0; i < 2048; i += 2)
+				myfree(live[i]);
+
+			clock_gettime(CLOCK_MONOTONIC, &execstart);
+			for (round = 0; round < rounds; round++)
+			{
+				if (pass == 0)
+				{
+					for (i = 0; i < group; i++)
+						blocks[i] = mymalloc(64);
+					for (i = 0; i < group; i++)
+						myfree(blocks[i]);
+				}
+				else
+				{
+					mymalloc_batch(64, blocks, group);
+					myfree_batch(blocks, group);
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &execend);
+			if (pass == 0)
+				single = elapsed_ns(&execstart, &execend);
+			else
+				batched = elapsed_ns(&execstart, &execend);
+		}
+
+		fprintf(log,"\t%-6s one by one %8.2fms, batched %8.2fms\n", strategy_name(strategy), single / 1e6, batched / 1e6);
+		free(live);
+		free(blocks);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* Gets a linked structure back after a restart: rebuilt, reopened from a clean pool file, and after a crash */
+int bench_restart(int argc, char **argv)
+{
+	int count = 200000;
+	const char *path = "bench.pool";
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Restoring a list of %d blocks\n",count);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		struct timespec execstart, execend;
+		double rebuilt, reopened, recovered;
+		pid_t child;
+
+		unlink(path);
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		initmem_file(path, strategy, 64 * count);
+		pool_file_build(count);
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		rebuilt = elapsed_ns(&execstart, &execend);
+		initmem(strategy, 4096);
+
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		initmem_file(path, strategy, 0);
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		reopened = elapsed_ns(&execstart, &execend);
+		initmem(strategy, 4096);
+
+		child = fork();
+		if (child == 0)
+		{
+			initmem_file(path, strategy, 0);
+			_exit(0);
+		}
+		waitpid(child, NULL, 0);
+		clock_gettime(CLOCK_MONOTONIC, &execstart);
+		initmem_file(path, strategy, 0);
+		clock_gettime(CLOCK_MONOTONIC, &execend);
+		recovered = elapsed_ns(&execstart, &execend);
+		if (!pool_file_list(count))
+		{
+			fclose(log);
+			return 1;
+		}
+		initmem(strategy, 4096);
+		unlink(path);
+
+		fprintf(log,"\t%-6s rebuilt %8.2fms, reopened %8.3fms, recovered after a crash %8.2fms\n", strategy_name(strategy), rebuilt / 1e6, reopened / 1e6, recovered / 1e6);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* The randomized test at a fill ratio of 0.9 with handles, with and without compacting when an allocation fails */
+int bench_compact(int argc, char **argv)
+{
+	int iterations = 100000;
+	int strategy;
+	int lbound = 1;
+	int ubound = NUM_STRATEGIES;
+
+	if (strategyFromString(*(argv+1))>0)
+		lbound=ubound=strategyFromString(*(argv+1));
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"%d random handle allocations and frees of 1-500 bytes at a fill ratio of 0.9\n",iterations);
+
+	for (strategy = lbound; strategy <= ubound; strategy++)
+	{
+		int failed[2];
+		double pause = 0;
+		int pass;
+
+		for (pass = 0; pass < 2; pass++)
+		{
+			mem_handle_t handles[10000];
+			int stored = 0;
+			int i;
+
+			srand(1);
+			failed[pass] = 0;
+			initmem(strategy, 100000);
+			for (i = 0; i < iterations; i++)
+			{
+				if (mem_free() > 100000 * 0.1)
+				{
+					int size = rand() % 500 + 1;
+					mem_handle_t handle = mymalloc_handle(size);
+					if (handle == 0 && pass == 1)
+					{
+						/* compact in slices, timing the longest */
+						int more = 1;
+						while (more)
+						{
+							struct timespec execstart, execend;
+							clock_gettime(CLOCK_MONOTONIC, &execstart);
+							more = mem_compact(16384);
+							clock_gettime(CLOCK_MONOTONIC, &execend);
+							if (elapsed_ns(&execstart, &execend) > pause)
+								pause = elapsed_ns(&execstart, &execend);
+						}
+						handle = mymalloc_handle(size);
+					}
+					if (handle == 0)
+						failed[pass]++;
+					else
+						handles[stored++] = handle;
+				}
+				else if (stored > 0)
+				{
+					int chosen = rand() % stored;
+					myfree_handle(handles[chosen]);
+					handles[chosen] = handles[--stored];
+				}
+			}
+		}
+
+		fprintf(log,"\t%-6s failed allocations %6d without compaction, %6d with (longest slice %6.1fus)\n", strategy_name(strategy), failed[0], failed[1], pause / 1e3);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+/* First and next fit in a full pool with a hole every 100 blocks: time per allocation that fills a hole.
+	Then first fit past a small hole every other block, to the free half of the pool. */
+int bench_scan(int argc, char **argv)
+{
+	strategies strategies[] = {First, Next, Bitmap};
+	int counts[] = {10000, 100000, 1000000};
+	int blockSize = 16;
+	int c, s;
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"Scan cost: %d byte blocks filling a hole every 100 blocks\n",blockSize);
+
+	for (c = 0; c < sizeof(counts)/sizeof(counts[0]); c++)
+	{
+		int n = counts[c];
+		void **pointers = malloc(n * sizeof(void *));
+
+		fprintf(log,"\t%8d blocks:", n);
+		for (s = 0; s < 3; s++)
+		{
+			struct timespec execstart, execend;
+			int i;
+
+			initmem(strategies[s], (size_t)n * blockSize);
+			for (i = 0; i < n; i++)
+				pointers[i] = mymalloc(blockSize);
+			for (i = 0; i < n; i += 100)
+				myfree(pointers[i]);
+
+			clock_gettime(CLOCK_MONOTONIC, &execstart);
+			for (i = 0; i < n; i += 100)
+			{
+				if (mymalloc(blockSize) == NULL)
+				{
+					printf("Hole %d of %d not filled with %s\n", i / 100, n / 100, strategy_name(strategies[s]));
+					return 1;
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &execend);
+
+			fprintf(log," %s %10.1f ns per malloc", strategy_name(strategies[s]), elapsed_ns(&execstart, &execend) / (n / 100));
+		}
+		fprintf(log,"\n");
+		free(pointers);
+	}
+
+	/* the free tree of First skips the holes; Bitmap has to look at every word with one */
+	fprintf(log,"First fit past %d byte holes every other block\n",blockSize);
+	for (c = 0; c < sizeof(counts)/sizeof(counts[0]); c++)
+	{
+		int n = counts[c];
+		void **pointers = malloc(n * sizeof(void *));
+
+		fprintf(log,"\t%8d blocks:", n);
+		for (s = 0; s < 3; s += 2)
+		{
+			struct timespec execstart, execend;
+			int i;
+
+			initmem(strategies[s], (size_t)n * blockSize * 2);
+			for (i = 0; i < n; i++)
+				pointers[i] = mymalloc(blockSize);
+			for (i = 0; i < n; i += 2)
+				myfree(pointers[i]);
+
+			clock_gettime(CLOCK_MONOTONIC, &execstart);
+			for (i = 0; i < 1000; i++)
+			{
+				if (mymalloc(blockSize * 2) == NULL)
+				{
+					printf("Allocation %d past the holes failed with %s\n", i, strategy_name(strategies[s]));
+					return 1;
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &execend);
+
+			fprintf(log," %s %10.1f ns per malloc", strategy_name(strategies[s]), elapsed_ns(&execstart, &execend) / 1000);
+		}
+		fprintf(log,"\n");
+		free(pointers);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+
+/* TLSF promises a bounded malloc, so the slowest one counts as much as the average */
+int bench_tlsf(int argc, char **argv)
+{
+	int counts[] = {65536, 524288, 2097152};
+	int blockSize = 32;
+	int c;
+
+	FILE *log;
+	log = fopen("bench.log","a");
+	if(log == NULL) {
+	  perror("Can't append to log file.\n");
+	  return 1;
+	}
+	fprintf(log,"TLSF malloc latency: %d byte blocks into an empty pool\n",blockSize);
+
+	for (c = 0; c < sizeof(counts)/sizeof(counts[0]); c++)
+	{
+		int n = counts[c];
+		double total = 0, worst = 0;
+		int i;
+
+		initmem(Tlsf, (size_t)n * blockSize);
+		for (i = 0; i < n; i++)
+		{
+			struct timespec execstart, execend;
+			double ns;
+
+			clock_gettime(CLOCK_MONOTONIC, &execstart);
+			if (mymalloc(blockSize) == NULL)
+			{
+				printf("Allocation %d of %d failed\n", i, n);
+				return 1;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &execend);
+			ns = elapsed_ns(&execstart, &execend);
+			total += ns;
+			worst = ns > worst ? ns : worst;
+		}
+
+		fprintf(log,"\t%8d blocks: %.1f ns per malloc, slowest %.1f ns\n", n, total / n, worst);
+	}
+
+	fclose(log);
+	return 0;
+}
+
+
 int run_memory_tests(int argc, char **argv)
 {
 	if (argc < 3)
@@ -457,6 +2987,37 @@ int run_memory_tests(int argc, char **argv)
 		{"alloc3","suite1",test_alloc_3},
 		{"alloc4","suite2",test_alloc_4},
 		{"stress","suite3",do_stress_tests},
+		{"threadstress","suite3",do_threaded_stress_tests},
+		{"histogram","suite4",test_free_histogram},
+		{"interior","suite4",test_interior_bytes},
+		{"lookupcost","suite4",test_lookup_cost},
+		{"alloctable","suite4",test_alloc_table},
+		{"buddy","suite4",test_buddy},
+		{"bitmap","suite4",test_bitmap},
+		{"aligned","suite4",test_aligned},
+		{"realloc","suite4",test_realloc},
+		{"batch","suite4",test_batch},
+		{"mmap","suite4",test_mmap},
+		{"growable","suite4",test_growable},
+		{"poolfile","suite4",test_pool_file},
+		{"compact","suite4",test_compact},
+		{"freelist","suite4",test_free_list},
+		{"slabs","suite4",test_slabs},
+		{"tags","suite4",test_boundary_tags},
+		{"pools","suite4",test_pools},
+		{"threadcache","suite4",test_thread_cache},
+		{"arenas","suite4",test_arenas},
+		{"remotefree","suite4",test_remote_free},
+		{"benchfree","bench",bench_free},
+		{"benchops","bench",bench_ops},
+		{"benchcapacity","bench",bench_capacity},
+		{"benchremote","bench",bench_remote_free},
+		{"benchrealloc","bench",bench_realloc},
+		{"benchbatch","bench",bench_batch},
+		{"benchrestart","bench",bench_restart},
+		{"benchcompact","bench",bench_compact},
+		{"benchscan","bench",bench_scan},
+		{"benchtlsf","bench",bench_tlsf},
 	};
 
  	return run_testrunner(argc,argv,tests,sizeof(tests)/sizeof(testentry_t));
@@ -4,8 +4,42 @@
 #include <assert.h>
 #include "mymem.h"
 #include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 
+/* Link embedded in a node for each AVL tree that indexes it.
+ * height is 0 while the node is not in the tree.
+ */
+struct memTreeLink
+{
+    struct memTreeLink *left;
+    struct memTreeLink *right;
+    int height;
+    size_t count; // Number of links in this subtree
+};
+
+/* An intrusive AVL tree. compare() must be a total order on the nodes in the tree.
+ * update(), if set, recomputes whatever else a link keeps about its subtree;
+ * it is called wherever the height and count of a link are.
+ */
+struct memTree
+{
+    struct memTreeLink *root;
+    int (*compare)(struct memTreeLink *a, struct memTreeLink *b);
+    void (*update)(struct memTreeLink *link);
+};
+
 /* The main structure for implementing memory allocation.
  * You may change this to fit your implementation.
  */
@@ -19,569 +53,5700 @@ struct memoryList //This is a node
     size_t size;         // How many bytes in this block?
     char alloc;          // 1 if this block is allocated,
     // 0 if this block is free.
+    char slab;           // 1 if this allocated block is a slab of small blocks
+    char indexed;        // 1 while this free block is in the free indexes
     void *ptr;           // location of block in memory pool.
+
+    struct memTreeLink byAddress; // Link in nodesByAddress (every node, not TLSF)
+    struct memTreeLink bySize;    // Link in freeBySize (free nodes, not TLSF)
+    struct memTreeLink byFreeAddress; // Link in freeByAddress (free nodes of First and Next only)
+    size_t maxFreeBelow;  // Largest size in the freeByAddress subtree of this node
+    size_t heapIndex;          // Position in freeHeap (free nodes of Worst only)
+
+    // doubly-linked list of the free nodes by address (First and Next only)
+    struct memoryList *freeLast;
+    struct memoryList *freeNext;
+
+    // doubly-linked list of the free nodes in the same TLSF size class (TLSF only)
+    struct memoryList *binLast;
+    struct memoryList *binNext;
+
+    size_t requested;    // Bytes asked for when size was rounded up (Buddy and Bitmap only)
+    size_t handle;       // Handle of a block from mem_pool_malloc_handle(), 0 for every other node
 };
 
-void *malloc_first(size_t requested);
-void *malloc_next(size_t requested);
-void *malloc_best(size_t requested);
-void *malloc_worst(size_t requested);
-void printNode(struct memoryList *node);
-void removeNode(struct memoryList *node);
-struct memoryList *mergeFreeNodes(struct memoryList *firstNode, struct memoryList *lastNode);
-void freeNode(struct memoryList *node);
-void freeNodeAndRightNeighbors(struct memoryList *node);
+//Get the node that contains the given tree link
+#define nodeFromLink(link, member) ((struct memoryList *)((char *)(link) - offsetof(struct memoryList, member)))
 
+/*
+ * With MEM_BOUNDARY_TAGS all metadata is stored inside the pool memory (Knuth's
+ * boundary tags). The pool starts with a struct tagPoolHeader, followed by
+ * the blocks. Every block starts with a header word and ends with an
+ * identical footer word holding its size, with TAG_ALLOC set if allocated.
+ * Block sizes are multiples of 16 and every payload is 16-byte aligned.
+ * A free block keeps the offsets of the next and previous free block right
+ * after its header, forming a LIFO free list.
+ * Links are offsets from the start of the pool rather than pointers, so the pool does not
+ * depend on the address it is mapped at.
+ */
+#define TAG_ALLOC ((size_t)1)
+#define TAG_SIZE sizeof(size_t)       // One header or footer
+#define TAG_OVERHEAD (2 * TAG_SIZE)   // Header + footer of a block
+#define TAG_ALIGN 16
+#define TAG_MIN_BLOCK 32              // Tags + both free list links
+#define TAG_NONE ((size_t)-1)         // Offset meaning "no block"
 
-strategies myStrategy = NotSet;    // Current strategy
+struct tagPoolHeader
+{
+    size_t freeList;  // First free block
+    size_t rover;     // Free block where next fit starts searching
+    size_t start;     // First block
+    size_t end;       // Just past the last block
+    size_t holes;     // Running totals, as for the list
+    size_t allocated;
+    size_t free;
+};
 
+void *malloc_first(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_next(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_best(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_worst(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_tlsf(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_buddy(mem_pool_t *pool, size_t alignment, size_t requested);
+void *malloc_bitmap(mem_pool_t *pool, size_t alignment, size_t requested);
+void buddyInit(mem_pool_t *pool, struct memoryList *node);
+void buddyFreeNode(mem_pool_t *pool, struct memoryList *node);
+int buddySplit(mem_pool_t *pool, struct memoryList *node);
+void *tagMallocAligned(mem_pool_t *pool, size_t alignment, size_t requested);
+void *tagAllocAt(mem_pool_t *pool, size_t block, size_t blockSize, size_t size);
+size_t alignPadding(void *ptr, size_t alignment);
+void *allocAlignedOnNode(mem_pool_t *pool, struct memoryList *node, size_t alignment, size_t requested);
+struct memoryList *smallestFreeFittingAligned(struct memTreeLink *link, size_t alignment, size_t requested);
+struct memoryList *largestFreeFittingAligned(struct memTreeLink *link, size_t alignment, size_t requested);
+void printNode(struct memoryList *node);
+void removeNode(mem_pool_t *pool, struct memoryList *node);
+struct memoryList *mergeFreeNodes(mem_pool_t *pool, struct memoryList *firstNode, struct memoryList *lastNode);
+void freeNode(mem_pool_t *pool, struct memoryList *node);
+struct memoryList *newNode(mem_pool_t *pool);
+void tagInit(mem_pool_t *pool);
+void *tagMalloc(mem_pool_t *pool, size_t requested);
+void tagFree(mem_pool_t *pool, void *block);
+int tagLargestFree(mem_pool_t *pool);
+int tagSmallFree(mem_pool_t *pool, int size);
+int tagFreeHistogram(mem_pool_t *pool, int *counts, int buckets);
+char tagIsAllocAt(mem_pool_t *pool, void *ptr);
+void tagPrintMemory(mem_pool_t *pool);
+struct tagPoolHeader *tagPool(mem_pool_t *pool);
+void tagPushFree(mem_pool_t *pool, size_t block);
+void recycleNode(mem_pool_t *pool, struct memoryList *node);
+void releaseNodeChunks(mem_pool_t *pool);
+void allocTableInit(mem_pool_t *pool);
+struct memoryList **allocTableAlloc(size_t capacity);
+void allocTableRelease(struct memoryList **table, size_t capacity, size_t from);
+void allocTableInsert(mem_pool_t *pool, struct memoryList *node);
+void allocTableRemove(mem_pool_t *pool, struct memoryList *node);
+struct memoryList *allocTableFind(mem_pool_t *pool, void *ptr);
+void indexFreeNode(mem_pool_t *pool, struct memoryList *node);
+void unindexFreeNode(mem_pool_t *pool, struct memoryList *node);
+int isFreeIndexed(struct memoryList *node);
+void treeInsert(struct memTree *tree, struct memTreeLink *link);
+struct memTreeLink *treeInsertNext(struct memTree *tree, struct memTreeLink *link);
+void treeRemove(struct memTree *tree, struct memTreeLink *link);
+int compareBySize(struct memTreeLink *a, struct memTreeLink *b);
+int compareByAddress(struct memTreeLink *a, struct memTreeLink *b);
+int compareByFreeAddress(struct memTreeLink *a, struct memTreeLink *b);
+void updateMaxFreeBelow(struct memTreeLink *link);
+struct memoryList *lowestFreeFitting(struct memTreeLink *link, size_t alignment, size_t requested);
+void treeRefresh(struct memTree *tree, struct memTreeLink *link);
+int keepsFreeList(mem_pool_t *pool);
+int keepsSizeTree(mem_pool_t *pool);
+int keepsHeap(mem_pool_t *pool);
+int keepsSizeClasses(mem_pool_t *pool);
+int keepsAddressTree(mem_pool_t *pool);
+void addressInsert(mem_pool_t *pool, struct memoryList *node);
+void addressRemove(mem_pool_t *pool, struct memoryList *node);
+int startTableResize(mem_pool_t *pool);
+void startTableInsert(mem_pool_t *pool, struct memoryList *node);
+void startTableRemove(mem_pool_t *pool, struct memoryList *node);
+struct memoryList *startTableHolding(mem_pool_t *pool, void *ptr);
+size_t startChunkOf(mem_pool_t *pool, void *ptr);
+void startBitSet(mem_pool_t *pool, size_t chunk);
+void startBitClear(mem_pool_t *pool, size_t chunk);
+size_t startBitPrev(mem_pool_t *pool, size_t chunk);
+void freeListInsert(mem_pool_t *pool, struct memoryList *node);
+void freeListRemove(mem_pool_t *pool, struct memoryList *node);
+void freeListReplace(mem_pool_t *pool, struct memoryList *node, struct memoryList *replacement);
+int isFreeListed(struct memoryList *node);
+void roverSkip(mem_pool_t *pool, struct memoryList *node);
+void roverConsider(mem_pool_t *pool, struct memoryList *node);
+void treeReplace(struct memTree *tree, struct memTreeLink *link, struct memTreeLink *replacement);
+struct memoryList *freeNodeAfter(mem_pool_t *pool, void *ptr);
+void setLastVisited(mem_pool_t *pool, struct memoryList *node);
+struct memoryList *smallestFreeFitting(mem_pool_t *pool, size_t requested);
+void heapPush(mem_pool_t *pool, struct memoryList *node);
+void heapRemove(mem_pool_t *pool, struct memoryList *node);
+void tlsfInsert(mem_pool_t *pool, struct memoryList *node);
+void tlsfRemove(mem_pool_t *pool, struct memoryList *node);
+void tlsfInit(mem_pool_t *pool);
+struct memoryList *tlsfFindFitting(mem_pool_t *pool, size_t requested);
+int scanHoles(mem_pool_t *pool);
+size_t treeCount(struct memTreeLink *link);
+int tlsfHighestBit(uint64_t size);
+int histogramBucket(size_t size);
+int tlsfLargestFree(mem_pool_t *pool);
+int tlsfSmallFree(mem_pool_t *pool, int size);
+int scanAllocated(mem_pool_t *pool);
+int scanFree(mem_pool_t *pool);
+int scanLargestFree(mem_pool_t *pool);
+void *centralMalloc(mem_pool_t *pool, size_t alignment, size_t requested);
+void centralFree(mem_pool_t *pool, void *block);
+void *cacheMalloc(mem_pool_t *pool, size_t requested);
+void cacheFree(mem_pool_t *pool, void *block);
+void cacheRelease(void *data);
+void *cacheMallocAligned(mem_pool_t *pool, size_t alignment, size_t requested);
+void *cacheBlockStart(void *block);
+int isHandleBlock(mem_pool_t *pool, void *block);
+void *poolMalloc(mem_pool_t *pool, size_t alignment, size_t requested);
+void *slabMalloc(mem_pool_t *pool, size_t requested);
+struct slab *slabCreate(mem_pool_t *pool, int sizeClass);
+struct slab *slabOf(mem_pool_t *pool, void *block);
+int slabFree(mem_pool_t *pool, void *block);
+void slabPush(mem_pool_t *pool, struct slab *slab);
+void slabUnlink(mem_pool_t *pool, struct slab *slab);
+void slabRelease(mem_pool_t *pool, struct slab *slab);
+void slabReleaseEmpty(mem_pool_t *pool);
+size_t slabBlockSize(struct slab *slab);
+int slabIndex(struct slab *slab, void *ptr);
+mem_pool_t *createPoolAt(strategies strategy, void *memory, size_t sz, int flags);
+void *arenaMalloc(mem_pool_t *pool, size_t alignment, size_t requested);
+mem_pool_t *arenaOf(mem_pool_t *pool, void *ptr);
+int homeArena(mem_pool_t *pool);
+void pushRemoteFree(mem_pool_t *arena, void *block);
+void drainRemoteFrees(mem_pool_t *arena);
+size_t remoteFreeSize(size_t requested);
+void drainAllRemoteFrees(mem_pool_t *pool);
+int arenaSum(mem_pool_t *pool, int (*stat)(mem_pool_t *arena));
+int centralResize(mem_pool_t *pool, void *block, size_t requested);
+size_t centralBlockSize(mem_pool_t *pool, void *block);
+void shrinkNode(mem_pool_t *pool, struct memoryList *node, size_t requested);
+void growNode(mem_pool_t *pool, struct memoryList *node, size_t requested);
+int buddyResize(mem_pool_t *pool, struct memoryList *node, size_t requested);
+int tagResize(mem_pool_t *pool, void *ptr, size_t requested);
+int centralMallocBatch(mem_pool_t *pool, size_t size, void **out, int n);
+int listMallocBatch(mem_pool_t *pool, size_t size, void **out, int n);
+int tagMallocBatch(mem_pool_t *pool, size_t size, void **out, int n);
+void listFreeBatch(mem_pool_t *pool, void **ptrs, int n);
+int compareAddresses(const void *a, const void *b);
+void *poolMemoryAlloc(size_t sz, int flags, size_t *mappedSize);
+void poolMemoryRelease(void *memory, size_t mappedSize);
+size_t poolPageSize(int flags);
+void releaseHole(mem_pool_t *pool, void *start, size_t size, size_t keepFront, size_t keepBack);
+void *strategyMalloc(mem_pool_t *pool, size_t alignment, size_t requested);
+int growPool(mem_pool_t *pool, size_t needed);
+void tagGrow(mem_pool_t *pool);
+size_t trimPoint(mem_pool_t *pool);
+struct memoryList *lastNode(mem_pool_t *pool);
+void poolFileClose(mem_pool_t *pool);
+void poolFileAbandon(const char *path, int fd, int sized);
+void tagRecover(mem_pool_t *pool);
+struct memoryList *nodeHolding(mem_pool_t *pool, void *ptr);
+size_t compactStep(mem_pool_t *pool, struct memoryList *node, size_t limit);
+size_t granuleCount(size_t bytes);
+int granuleResize(mem_pool_t *pool);
+void granuleMark(mem_pool_t *pool, void *ptr, size_t size, int allocated);
+char granuleTest(mem_pool_t *pool, void *ptr);
+size_t granuleFind(mem_pool_t *pool, size_t count, size_t limit);
+void granuleSelect(void);
+uint64_t granuleRuns(uint64_t clear, size_t count);
+size_t granuleSkipScalar(const uint64_t *words, size_t from, size_t to, uint64_t value);
+size_t granuleScanScalar(const uint64_t *words, size_t from, size_t to, size_t count);
+#if defined(__x86_64__) || defined(__i386__)
+size_t granuleSkipSse2(const uint64_t *words, size_t from, size_t to, uint64_t value);
+size_t granuleScanSse2(const uint64_t *words, size_t from, size_t to, size_t count);
+size_t granuleSkipAvx2(const uint64_t *words, size_t from, size_t to, uint64_t value);
+size_t granuleScanAvx2(const uint64_t *words, size_t from, size_t to, size_t count);
+#endif
+int granuleHoles(mem_pool_t *pool);
+int granuleAllocated(mem_pool_t *pool);
 
-size_t mySize;
-void *myMemory = NULL;
 
-struct memoryList *head;
-struct memoryList *lastVisited; //Only used for next fit strategy.
 int debugMessages = 0;
 
+/* With the Bitmap strategy every block is a whole number of GRANULE_SIZE
+ * byte granules and starts at one, and the pool keeps a bit per granule.
+ * granuleSkip() and granuleScan() are the scans granuleFind() spends most
+ * of its time in, picked once for the CPU we run on. granuleScan() is for
+ * runs of up to GRANULE_SHORT_RUN granules.
+ */
+#define GRANULE_SIZE 16
+#define GRANULE_SHORT_RUN 32
 
-void initmem(strategies strategy, size_t sz)
+/* TLSF pools find the node holding an address through a table with an
+ * entry per START_CHUNK bytes, so a lookup walks no more than the nodes
+ * that start in one chunk. START_LEVELS levels of bits cover any number
+ * of chunks.
+ */
+#define START_CHUNK 64
+#define START_LEVELS 11
+
+size_t (*granuleSkip)(const uint64_t *words, size_t from, size_t to, uint64_t value);
+size_t (*granuleScan)(const uint64_t *words, size_t from, size_t to, size_t count);
+pthread_once_t granuleSelectOnce = PTHREAD_ONCE_INIT;
+
+/* Nodes are carved out of chunks owned by the pool instead of being
+ * malloc'ed one by one. Removed nodes go on recycledNodes (linked through
+ * next) and are handed out again first. Destroying the pool releases every chunk.
+ */
+#define NODES_PER_CHUNK 256
+
+struct nodeChunk
 {
-    myStrategy = strategy;
+    struct nodeChunk *next;
+    struct memoryList nodes[NODES_PER_CHUNK];
+};
 
-    /* all implementations will need an actual block of memory to use */
-    mySize = sz;
+/* Two-Level Segregated Fit index of every free node.
+ * Sizes below TLSF_SL_COUNT each get their own class (first level 0).
+ * Above that, the first level is the power of two of the size and the
+ * second level splits that range into TLSF_SL_COUNT equal classes.
+ * A bit is set in the bitmaps for every non-empty class.
+ */
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT (64 - TLSF_SL_LOG2 + 1)
 
-    /* release any other memory you were using for bookkeeping when doing a re-initialization! */
-    if (head != NULL)
-        freeNodeAndRightNeighbors(head); //This frees all nodes including lastVisited
-    if (myMemory != NULL)
-        free(myMemory);
+/* With MEM_THREAD_CACHE every thread keeps freed blocks of up to
+ * CACHE_MAX_SIZE bytes in CACHE_CLASSES bins of 16-byte size classes,
+ * and hands them out again without taking the pool lock. Each block is
+ * preceded by CACHE_HEADER bytes holding its class (CACHE_CLASSES for
+ * blocks that bypass the cache) and, for those, how far before it the
+ * block handed out by the pool starts, which is further for aligned blocks.
+ * Blocks are taken from the pool CACHE_HEADER-aligned, so the header and
+ * the block after it are too. A bin holding more than CACHE_LIMIT blocks
+ * gives half of them back to the pool; an empty bin takes CACHE_REFILL
+ * blocks from the pool at once.
+ */
+#define CACHE_HEADER 16
+#define CACHE_CLASSES 16
+#define CACHE_MAX_SIZE (CACHE_CLASSES * 16)
+#define CACHE_LIMIT 64
+#define CACHE_REFILL 8
+
+/* With MEM_SMALL_SLABS, requests of up to SLAB_MAX_SIZE bytes are rounded
+ * up to one of SLAB_CLASSES 16-byte size classes and served from slabs.
+ * A slab is an allocated block of SLAB_SIZE bytes, aligned to its size, so
+ * the slab of a small block is found by rounding its address down. It
+ * starts with a struct slab, followed by its blocks. A slab with a free
+ * block is on the list of its class; one without allocated blocks is given
+ * back to the pool, unless it is the only slab on that list.
+ */
+#define SLAB_SIZE 4096
+#define SLAB_CLASSES 16
+#define SLAB_MAX_SIZE (SLAB_CLASSES * 16)
+#define SLAB_HEADER ((sizeof(struct slab) + 15) / 16 * 16)
+#define SLAB_BITMAP_WORDS ((SLAB_SIZE / 16 + 63) / 64)
 
-    /* Initialize memory management structure. */
-    myMemory = malloc(sz);//Allocate the memory
+struct slab
+{
+    struct slab *last; // Slabs of the same class with a free block, see mem_pool.slabs
+    struct slab *next;
+    uint32_t sizeClass;
+    uint32_t used;     // Allocated blocks
+    uint32_t blocks;   // Blocks that fit after the header
+    uint64_t bitmap[SLAB_BITMAP_WORDS]; // Bit i is set if block i is allocated, and for every i >= blocks
+};
 
-    head = (struct memoryList *)malloc(sizeof(struct memoryList));
-    head->last = NULL; // No link before head yet
-    head->next = NULL; // No link after head yet
-    head->size = sz; // assign it all the space available
-    head->alloc = 0; // It is not yet allocated
-    head->ptr = myMemory;
+struct threadCache
+{
+    mem_pool_t *pool;
+    struct threadCache *last; // Every cache of the pool, see mem_pool.caches
+    struct threadCache *next;
+    void *bins[CACHE_CLASSES]; // Cached blocks of each class, linked through their first word
+    int binCounts[CACHE_CLASSES];
+};
 
-    //For the "next fit" we need to keep track of lastVisited
-    lastVisited = head;
-}
+/* Everything one pool owns. mem_pool_create() makes one; initmem(),
+ * mymalloc(), myfree() and the mem_*() functions use defaultPool.
+ */
+struct mem_pool
+{
+    strategies strategy;    // Current strategy
+    int flags;              // MEM_* flags passed to mem_pool_create()
 
-void freeNodeAndRightNeighbors(struct memoryList *node){
-    //Free right neighbors
-    if (node->next != NULL){
-        freeNodeAndRightNeighbors(node->next);
-    }
+    pthread_mutex_t lock;   // Held for every access to the state below
+    pthread_key_t cacheKey; // The calling thread's struct threadCache (MEM_THREAD_CACHE only)
+    struct threadCache *caches; // Every thread's cache, so destroying the pool can free them
 
-    //Free node itself (Not the node->ptr, which is only allocaed in myMemory)
-    free(node);
-}
+    size_t size;
+    void *memory;
+    int ownsMemory;         // 0 for an arena, whose memory belongs to its parent
+    size_t mappedSize;      // Length of the mapping holding memory with MEM_MMAP, else 0
+    size_t minSize;         // Size the pool was created with; mem_pool_trim() keeps at least this
+    struct poolFileHeader *file; // Start of the mapped file of mem_pool_open_file(), else NULL
+    int fileLock;                // Descriptor of that file, holding its flock() until it is closed
+
+    /* Blocks of mem_pool_malloc_handle(): handles[h - 1] is the block of
+     * handle h, or NULL; the free entries are stacked in freeHandles.
+     * mem_pool_compact() works from compactOffset on and moves handle blocks.
+     */
+    void **handles;
+    size_t *freeHandles;
+    size_t handleCount;       // Entries in use or stacked
+    size_t handleCapacity;
+    size_t freeHandleCount;
+    size_t compactOffset;
+    size_t releasePage;     // poolPageSize(): pages given back, committed and trimmed are multiples of this
+
+    /* Set for a pool made by mem_pool_create_arenas(). Such a pool only
+     * splits memory into arenaCount arenas of arenaSize bytes (the last
+     * one takes the rest) and forwards every call to them; none of the
+     * fields below are used.
+     */
+    mem_pool_t **arenas;
+    int arenaCount;
+    size_t arenaSize;
+
+    /* With MEM_REMOTE_FREE, blocks of this arena freed by threads of other
+     * arenas, linked through their first word. Pushed without the lock;
+     * taken all at once under it.
+     */
+    _Atomic(void *) remoteFrees;
+
+    struct memoryList *head;
+    struct memoryList *lastVisited; //Only used for next fit strategy.
+    struct memoryList *rover; //Next fit: the first free node after lastVisited, wrapping around
+
+    struct nodeChunk *nodeChunks; // Newest chunk first
+    size_t nodeChunkUsed;         // Nodes handed out from the newest chunk
+    struct memoryList *recycledNodes;
+
+    /* Running totals, kept up to date by the free indexes and allocOnNode()/freeNode() */
+    size_t holeCount;
+    size_t allocatedBytes;
+    size_t freeBytes;
+    size_t freeHistogram[64]; // Free nodes per power-of-two size range
+    size_t requestedBytes;    // Bytes asked for by the allocated nodes (Buddy and Bitmap only)
+
+    /* Open-addressing hash table of the allocated nodes, keyed by their offset
+     * into memory. myfree() uses it to find a node without walking the list.
+     * Only allocated nodes are stored, so merging free nodes never touches it.
+     * Growing it doesn't rehash every node at once: the nodes of the table it
+     * replaces stay in allocTableOld until allocTableMigrate() has moved them,
+     * a few slots per insert, and its pages are unmapped as they are passed,
+     * so no single malloc pays for the whole table.
+     */
+    struct memoryList **allocTable;
+    size_t allocTableCapacity; // Always a power of two
+    size_t allocTableCount;    // Nodes in both tables
+    int allocTableShift; // 64 - log2(allocTableCapacity)
+    struct memoryList **allocTableOld; // Half the capacity, or NULL once moved over
+    size_t allocTableMoved;            // Slots of allocTableOld moved so far
+
+    /* Every node, ordered by address. Finds the block that contains any byte
+     * of the pool. Not kept by TLSF, whose malloc and free stay O(1); it
+     * keeps startTable instead.
+     */
+    struct memTree nodesByAddress;
+
+    /* TLSF only: startTable[i] is the lowest node that starts in the
+     * START_CHUNK bytes at i * START_CHUNK into memory, or NULL. Bit i of
+     * startBits[0] is set while entry i isn't NULL, and bit i of
+     * startBits[l + 1] while word i of startBits[l] isn't 0, so the last
+     * chunk before another one where a node starts takes a word per level
+     * to find. See startTableHolding().
+     */
+    struct memoryList **startTable;
+    size_t startChunks;                // Entries in startTable
+    uint64_t *startBits[START_LEVELS];
+    int startLevels;                   // Levels in use; the top one is a single word
+
+    /* Every free node, ordered by (size, address). Best fit is a lower-bound
+     * lookup. Not kept by TLSF, whose size classes answer the same questions.
+     */
+    struct memTree freeBySize;
+
+    /* First and Next only: every free node, ordered by address, both as a tree
+     * and as a list from freeHead to freeTail. Next fit walks the list, so it
+     * never steps over an allocated node; the tree finds a node's place in it.
+     * Each node of the tree keeps the largest size in its subtree, so first
+     * fit descends to the lowest hole that fits, and the root has the largest
+     * free size. These pools keep no freeHeap.
+     */
+    struct memTree freeByAddress;
+    struct memoryList *freeHead;
+    struct memoryList *freeTail;
+
+    /* Worst only: binary max-heap of every free node, ordered by size (lowest
+     * address wins ties). Each node stores its position in heapIndex, so it can
+     * be removed from anywhere. freeHeap[0] is the worst fit.
+     */
+    struct memoryList **freeHeap;
+    size_t freeHeapCount;
+    size_t freeHeapCapacity;
+
+    /* TLSF only: the free nodes by size class; see tlsfFindFitting() */
+    uint64_t tlsfFirstLevel;
+    uint32_t tlsfSecondLevel[TLSF_FL_COUNT];
+    struct memoryList *tlsfBins[TLSF_FL_COUNT][TLSF_SL_COUNT];     // Oldest node of each class
+    struct memoryList *tlsfBinTails[TLSF_FL_COUNT][TLSF_SL_COUNT]; // Newest node of each class
+    size_t tlsfBinCounts[TLSF_FL_COUNT][TLSF_SL_COUNT];            // Nodes in each class
+
+    struct slab *slabs[SLAB_CLASSES]; // MEM_SMALL_SLABS: slabs of each class with a free block
+
+    /* Bitmap only: bit i is set while granule i, the GRANULE_SIZE bytes at
+     * i * GRANULE_SIZE into memory, is allocated. See granuleFind().
+     */
+    uint64_t *granules;
+    size_t granuleWords; // Words allocated for granules
+    size_t granuleHint;  // Every word before this one is all set
+};
+
+/* Alignment of the memory of a pool */
+#define POOL_ALIGN 4096
+
+/* With MEM_MMAP, free holes of at least RELEASE_THRESHOLD bytes give their
+ * pages back to the OS. Like glibc's trim threshold, it keeps small holes
+ * next to busy blocks from costing a system call on every free.
+ */
+#define RELEASE_THRESHOLD (128 * 1024)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Address range a MEM_GROWABLE pool reserves, unless it starts out larger.
+ * Only what has been committed counts against memory.
+ */
+#define GROW_RESERVE (sizeof(void *) > 4 ? (size_t)1 << 36 : (size_t)1 << 30)
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
 
+/* A pool file (mem_pool_open_file()) is this header, padded to a page,
+ * followed by a boundary tag pool, whose metadata is all offsets and so
+ * reads the same wherever the file is mapped. clean is 0 while a process
+ * has the file open, so after a crash the pool is recovered by tagRecover().
+ */
+#define POOL_FILE_MAGIC "mymempl"
+#define POOL_FILE_VERSION 1
+#define POOL_FILE_HEADER 4096
+
+struct poolFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t strategy;  // Strategy it was last opened with
+    uint64_t size;      // Bytes of pool after the header
+    uint64_t root;      // Offset of the block set by mem_pool_set_root(), or TAG_NONE
+    uint64_t clean;     // 1 if the file was closed by mem_pool_destroy()
+};
+
+/* Internal flag: createPoolAt() keeps the tag layout already in memory */
+#define POOL_REOPEN 0x40000000
+
+/* The pool behind initmem(), mymalloc(), myfree() and the mem_*() functions */
+mem_pool_t *defaultPool = NULL;
+
+/* Build with -DMYMEM_DEBUG to check every running total against a full scan */
+#ifdef MYMEM_DEBUG
+#define CHECK_TOTAL(total, scan) assert((int)(total) == scan(pool))
+#else
+#define CHECK_TOTAL(total, scan)
+#endif
 /**
- Allocate a block of memory with the requested size.
- If the requested block is not available, mymalloc returns NULL.
- Otherwise, it returns a pointer to the newly allocated block.
- Restriction: requested >= 1
+ Creates a pool of sz bytes that hands out blocks with the given strategy.
+ flags are MEM_* flags choosing how the pool is managed.
+ Returns NULL if the memory for it can't be allocated.
  */
-void *mymalloc(size_t requested)
+mem_pool_t *mem_pool_create(strategies strategy, size_t sz, int flags)
 {
-    assert((int)myStrategy > 0);
-    void *ptr;
-    switch (myStrategy)
-    {
-        case NotSet:
-            break;
-        case First:
-            ptr = malloc_first(requested);
-            break;
-        case Best:
-            ptr = malloc_best(requested);
-            break;
-        case Worst:
-            ptr = malloc_worst(requested);
-            break;
-        case Next:
-            ptr = malloc_next(requested);
-            break;
+    /* all implementations will need an actual block of memory to use */
+    void *memory;
+    size_t mappedSize;
+    mem_pool_t *pool;
+
+    if (flags & (MEM_HUGE_PAGES | MEM_GROWABLE)){
+        flags |= MEM_MMAP;
     }
-    if (ptr == NULL && debugMessages) {
-        printf("Didn't find suitable memory in mymalloc()\n");
+    memory = poolMemoryAlloc(sz, flags, &mappedSize);
+    if (memory == NULL){
+        return NULL;
     }
-    return ptr;
+    pool = createPoolAt(strategy, memory, sz, flags);
+    if (pool == NULL){
+        poolMemoryRelease(memory, mappedSize);
+        return NULL;
+    }
+    pool->ownsMemory = 1;
+    pool->mappedSize = mappedSize;
+    pool->minSize = sz;
+    return pool;
 }
 
-
-/* Frees a block of memory previously allocated by mymalloc. */
-void myfree(void* block)
+/**
+ Like mem_pool_create(), but splits the sz bytes into the given number of
+ arenas. Each arena runs the strategy on its own part of the memory under
+ its own lock, so threads using different arenas don't wait for each other.
+ Threads are given arenas round-robin, and a full arena falls back to the
+ next ones. mem_pool_holes() counts the holes of each arena separately,
+ even where two of them meet. Pools too small for 16 bytes per arena
+ are not split.
+ */
+mem_pool_t *mem_pool_create_arenas(strategies strategy, size_t sz, int flags, int arenas)
 {
-    struct memoryList *node = head;
+    mem_pool_t *pool;
+    int i;
 
-    while (node)
-    {
-        //If node has the correct memory
-        if (node->ptr == block){
-            freeNode(node);
-            return;
-        }
-        node = node->next;
+    if (arenas <= 1 || sz / arenas < 16){
+        return mem_pool_create(strategy, sz, flags);
     }
-    if (debugMessages){
-        printf("Myfree didn't find the node it was looking for\n");
+    pool = (mem_pool_t *)calloc(1, sizeof(mem_pool_t));
+    if (pool == NULL){
+        return NULL;
+    }
+    if (flags & MEM_HUGE_PAGES){
+        flags |= MEM_MMAP;
+    }
+    //Arenas are fixed slices of the memory, so they can't grow
+    flags &= ~MEM_GROWABLE;
+    pool->strategy = strategy;
+    pool->flags = flags;
+    pool->size = sz;
+    pool->memory = poolMemoryAlloc(sz, flags, &pool->mappedSize);
+    pool->ownsMemory = 1;
+    pool->arenas = (mem_pool_t **)calloc(arenas, sizeof(mem_pool_t *));
+    pool->arenaCount = arenas;
+    //Multiples of 16 keep every arena as aligned as the memory itself
+    pool->arenaSize = sz / arenas / 16 * 16;
+    pthread_mutex_init(&pool->lock, NULL);
+    if (pool->memory == NULL || pool->arenas == NULL){
+        mem_pool_destroy(pool);
+        return NULL;
+    }
+    for (i = 0; i < arenas; i++){
+        size_t arenaSize = i < arenas - 1 ? pool->arenaSize : sz - i * pool->arenaSize;
+        pool->arenas[i] = createPoolAt(strategy, (char *)pool->memory + i * pool->arenaSize, arenaSize, flags);
+        if (pool->arenas[i] == NULL){
+            mem_pool_destroy(pool);
+            return NULL;
+        }
     }
+    return pool;
 }
 
-/****** Memory status/property functions ******
- * Implement these functions.
- * Note that when refered to "memory" here, it is meant that the
- * memory pool this module manages via initmem/mymalloc/myfree.
+/**
+ Creates a pool that manages the sz bytes at memory, without owning them.
  */
-
-/* Get the number of contiguous areas of free space in memory. */
-int mem_holes()
+mem_pool_t *createPoolAt(strategies strategy, void *memory, size_t sz, int flags)
 {
-    int holes = 0;
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 0){
-            holes++;
+    mem_pool_t *pool = (mem_pool_t *)calloc(1, sizeof(mem_pool_t));
+    if (pool == NULL){
+        return NULL;
+    }
+    pool->strategy = strategy;
+    pool->flags = flags & MEM_BOUNDARY_TAGS ? flags & ~MEM_SMALL_SLABS : flags; //Slabs are found through list nodes
+    pool->size = sz;
+    pool->memory = memory;
+    pool->releasePage = poolPageSize(flags);
+
+    if (pool->flags & MEM_THREAD_CACHE && pthread_key_create(&pool->cacheKey, cacheRelease) != 0){
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    pool->nodeChunkUsed = NODES_PER_CHUNK;
+    pool->nodesByAddress.compare = compareByAddress;
+    pool->freeBySize.compare = compareBySize;
+    pool->freeByAddress.compare = compareByFreeAddress;
+    pool->freeByAddress.update = updateMaxFreeBelow;
+
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        //All metadata lives inside the pool memory; no nodes at all
+        if (pool->flags & POOL_REOPEN){
+            pool->flags &= ~POOL_REOPEN;
+        } else {
+            tagInit(pool);
         }
-        node = node->next;
+        return pool;
     }
-    return holes;
+    if (pool->strategy == Bitmap){
+        pthread_once(&granuleSelectOnce, granuleSelect);
+        if (!granuleResize(pool)){
+            pthread_mutex_destroy(&pool->lock);
+            if (pool->flags & MEM_THREAD_CACHE){
+                pthread_key_delete(pool->cacheKey);
+            }
+            free(pool);
+            return NULL;
+        }
+    }
+
+    pool->head = newNode(pool);
+    pool->head->last = NULL; // No link before head yet
+    pool->head->next = NULL; // No link after head yet
+    pool->head->size = sz; // assign it all the space available
+    pool->head->alloc = 0; // It is not yet allocated
+    pool->head->ptr = pool->memory;
+
+    //For the "next fit" we need to keep track of lastVisited
+    pool->lastVisited = pool->head;
+
+    allocTableInit(pool);
+    if (!keepsAddressTree(pool) && !startTableResize(pool)){
+        mem_pool_destroy(pool);
+        return NULL;
+    }
+    addressInsert(pool, pool->head);
+    tlsfInit(pool);
+    indexFreeNode(pool, pool->head);
+    if (pool->strategy == Buddy){
+        buddyInit(pool, pool->head);
+    }
+    return pool;
 }
 
-/* Get the number of bytes allocated */
-int mem_allocated()
+/**
+ Releases the pool, its memory and all of its bookkeeping.
+ No other thread may use the pool any more.
+ */
+void mem_pool_destroy(mem_pool_t *pool)
 {
-    int bytesAllocated = 0;
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 1){
-            bytesAllocated += node->size;
+    int level;
+
+    if (pool == NULL){
+        return;
+    }
+    if (pool->arenas != NULL){
+        int i;
+        for (i = 0; i < pool->arenaCount; i++){
+            mem_pool_destroy(pool->arenas[i]);
+        }
+        free(pool->arenas);
+    } else if (pool->flags & MEM_THREAD_CACHE){
+        //The blocks in the caches are in pool memory; only the caches themselves need freeing
+        pthread_key_delete(pool->cacheKey);
+        while (pool->caches != NULL){
+            struct threadCache *next = pool->caches->next;
+            free(pool->caches);
+            pool->caches = next;
         }
-        node = node->next;
     }
-    return bytesAllocated;
+    pthread_mutex_destroy(&pool->lock);
+    releaseNodeChunks(pool); //This frees all nodes including head and lastVisited
+    allocTableRelease(pool->allocTable, pool->allocTableCapacity, 0);
+    allocTableRelease(pool->allocTableOld, pool->allocTableCapacity / 2, pool->allocTableMoved);
+    free(pool->freeHeap);
+    free(pool->handles);
+    free(pool->freeHandles);
+    free(pool->granules);
+    free(pool->startTable);
+    for (level = 0; level < START_LEVELS; level++){
+        free(pool->startBits[level]);
+    }
+    if (pool->file != NULL){
+        poolFileClose(pool);
+    } else if (pool->ownsMemory && pool->memory != NULL){
+        poolMemoryRelease(pool->memory, pool->mappedSize);
+    }
+    free(pool);
 }
 
-/* Number of non-allocated bytes */
-int mem_free()
-{
-    int bytesFree = 0;
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 0){
-            bytesFree += node->size;
+/**
+ Gets the sz bytes of a pool. With MEM_MMAP they are reserved with mmap
+ and *mappedSize is set to the length of the mapping; otherwise they come
+ from libc and *mappedSize is 0. Returns NULL if there is no memory.
+ */
+void *poolMemoryAlloc(size_t sz, int flags, size_t *mappedSize){
+    void *memory = NULL;
+    size_t length = sz > 0 ? sz : 1;
+
+    *mappedSize = 0;
+    if (flags & MEM_GROWABLE){
+        //growPool() and mem_pool_trim() take the committed part to end at a multiple of this
+        size_t page = poolPageSize(flags);
+        size_t committed = (length + page - 1) / page * page;
+        size_t reserve = length > GROW_RESERVE ? length : GROW_RESERVE;
+
+        reserve = (reserve + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        //Inaccessible until growPool() commits it
+        memory = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED){
+            return NULL;
         }
-        node = node->next;
+        if (mprotect(memory, committed, PROT_READ | PROT_WRITE) != 0){
+            munmap(memory, reserve);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (flags & MEM_HUGE_PAGES){
+            madvise(memory, reserve, MADV_HUGEPAGE);
+        }
+#endif
+        *mappedSize = reserve;
+        return memory;
     }
-    return bytesFree;
+    if (!(flags & MEM_MMAP)){
+        //Page aligned, so Buddy blocks are aligned to their size up to a page
+        if (posix_memalign(&memory, POOL_ALIGN, length) != 0){
+            return NULL;
+        }
+        return memory;
+    }
+#ifdef MAP_HUGETLB
+    if (flags & MEM_HUGE_PAGES){
+        size_t hugeLength = (length + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        //Reserved, or a touch could fault with SIGBUS when the huge pages run out
+        memory = mmap(NULL, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED){
+            *mappedSize = hugeLength;
+            return memory;
+        }
+    }
+#endif
+    memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED){
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (flags & MEM_HUGE_PAGES){
+        //No reserved huge pages; transparent ones are the next best thing
+        madvise(memory, length, MADV_HUGEPAGE);
+    }
+#endif
+    *mappedSize = length;
+    return memory;
 }
 
-/* Number of bytes in the largest contiguous area of unallocated memory */
-int mem_largest_free()
-{
-    int largestFree = 0;
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 0 && node->size > largestFree){
-            largestFree = node->size;
-        }
-        node = node->next;
+/**
+ The page size a pool with these flags commits and releases its memory in
+ */
+size_t poolPageSize(int flags){
+    return flags & MEM_HUGE_PAGES ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+}
+
+void poolMemoryRelease(void *memory, size_t mappedSize){
+    if (mappedSize > 0){
+        munmap(memory, mappedSize);
+    } else {
+        free(memory);
     }
-    return largestFree;
 }
 
-/* Number of free blocks smaller than "size" bytes. */
-int mem_small_free(int size)
-{
-    int numOfSmallFree = 0;
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 0 && node->size <= size){
-            numOfSmallFree++;
-        }
-        node = node->next;
+/**
+ With MEM_MMAP, gives the whole pages inside a free hole of at least
+ RELEASE_THRESHOLD bytes back to the OS. They are committed again, zeroed,
+ when next touched. keepFront and keepBack bytes at the ends of the hole
+ hold metadata and are kept. The caller holds pool->lock, so nobody can
+ allocate the hole meanwhile.
+ */
+void releaseHole(mem_pool_t *pool, void *start, size_t size, size_t keepFront, size_t keepBack){
+    uintptr_t first;
+    uintptr_t last;
+
+    if (!(pool->flags & MEM_MMAP) || size < RELEASE_THRESHOLD){
+        return;
+    }
+    first = ((uintptr_t)start + keepFront + pool->releasePage - 1) / pool->releasePage * pool->releasePage;
+    last = ((uintptr_t)start + size - keepBack) / pool->releasePage * pool->releasePage;
+    if (last > first){
+        madvise((void *)first, last - first, MADV_DONTNEED);
     }
-    return numOfSmallFree;
 }
 
-char mem_is_alloc(void *ptr)
-{
-    struct memoryList *node = head;
-    while (node){
-        if (node->alloc == 1 && node->ptr == ptr){
-            return 1;
-        } else if (node->alloc == 0 && node->ptr == ptr){
-            return 0;
+/**
+ Takes a node from the recycled nodes, or else from the newest chunk
+ */
+struct memoryList *newNode(mem_pool_t *pool){
+    struct memoryList *node;
+
+    if (pool->recycledNodes != NULL){
+        node = pool->recycledNodes;
+        pool->recycledNodes = node->next;
+    } else {
+        if (pool->nodeChunkUsed == NODES_PER_CHUNK){
+            struct nodeChunk *chunk = (struct nodeChunk *)malloc(sizeof(struct nodeChunk));
+            if (chunk == NULL){
+                return NULL;
+            }
+            chunk->next = pool->nodeChunks;
+            pool->nodeChunks = chunk;
+            pool->nodeChunkUsed = 0;
         }
-        node = node->next;
+        node = &pool->nodeChunks->nodes[pool->nodeChunkUsed++];
     }
-    return 0;
+    node->handle = 0;
+    node->slab = 0;
+    node->indexed = 0;              //Not in the free indexes
+    node->byFreeAddress.height = 0; //Not in freeByAddress
+    return node;
 }
 
-/*
- * Feel free to use these functions, but do not modify them.
- * The test code uses them, but you may find them useful.
+/**
+ Gives a node that is no longer in the list back for reuse
  */
+void recycleNode(mem_pool_t *pool, struct memoryList *node){
+    node->next = pool->recycledNodes;
+    pool->recycledNodes = node;
+}
 
-
-//Returns a pointer to the memory pool.
-void *mem_pool()
+/**
+ Frees every chunk, and with them every node of the pool
+ */
+void releaseNodeChunks(mem_pool_t *pool){
+    while (pool->nodeChunks != NULL){
+        struct nodeChunk *next = pool->nodeChunks->next;
+        free(pool->nodeChunks);
+        pool->nodeChunks = next;
+    }
+    pool->nodeChunkUsed = NODES_PER_CHUNK;
+    pool->recycledNodes = NULL;
+    pool->head = NULL;
+}
+/**
+ Allocate a block of memory with the requested size.
+ If the requested block is not available, mymalloc returns NULL.
+ Otherwise, it returns a pointer to the newly allocated block.
+ Restriction: requested >= 1
+ */
+void *mem_pool_malloc(mem_pool_t *pool, size_t requested)
 {
-    return myMemory;
+    assert(pool != NULL && (int)pool->strategy > 0);
+    void *ptr;
+    if (pool->arenas != NULL){
+        return arenaMalloc(pool, 1, requested);
+    }
+    if (pool->flags & MEM_THREAD_CACHE){
+        return cacheMalloc(pool, requested);
+    }
+    pthread_mutex_lock(&pool->lock);
+    ptr = centralMalloc(pool, 1, requested);
+    pthread_mutex_unlock(&pool->lock);
+    return ptr;
 }
 
-// Returns the total number of bytes in the memory pool. */
-int mem_total()
+/**
+ Like mem_pool_malloc(), with the block's address a multiple of alignment,
+ which must be a power of two. The free space skipped in front of the
+ block stays free. Returns NULL for any other alignment.
+ */
+void *mem_pool_malloc_aligned(mem_pool_t *pool, size_t alignment, size_t requested)
 {
-    return mySize;
+    void *ptr;
+    if (alignment <= 1){
+        return mem_pool_malloc(pool, requested);
+    }
+    if (alignment & (alignment - 1)){
+        return NULL;
+    }
+    if (pool->arenas != NULL){
+        return arenaMalloc(pool, alignment, requested);
+    }
+    if (pool->flags & MEM_THREAD_CACHE){
+        return cacheMallocAligned(pool, alignment, requested);
+    }
+    pthread_mutex_lock(&pool->lock);
+    ptr = centralMalloc(pool, alignment, requested);
+    pthread_mutex_unlock(&pool->lock);
+    return ptr;
 }
 
-
-// Get string name for a strategy.
-char *strategy_name(strategies strategy)
+/* Frees a block of memory previously allocated by mymalloc. */
+void mem_pool_free(mem_pool_t *pool, void* block)
 {
-    switch (strategy)
+    if (pool->arenas != NULL){
+        mem_pool_t *arena = arenaOf(pool, block);
+        if (arena != NULL && pool->flags & MEM_REMOTE_FREE && arena != pool->arenas[homeArena(pool)]){
+            pushRemoteFree(arena, block);
+        } else if (arena != NULL){
+            mem_pool_free(arena, block);
+        } else if (debugMessages){
+            printf("Myfree didn't find the node it was looking for\n");
+        }
+        return;
+    }
+    if (pool->flags & MEM_THREAD_CACHE){
+        cacheFree(pool, block);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    centralFree(pool, block);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ Allocates n blocks of size bytes and stores their addresses in out.
+ One search finds a hole for all of them, and they are carved out of it
+ back to back; if there is no such hole they are allocated one by one.
+ Returns the number of blocks allocated. The rest of out is set to NULL.
+ */
+int mem_pool_malloc_batch(mem_pool_t *pool, size_t size, void **out, int n)
+{
+    int count = 0;
+    int i;
+
+    if (pool->arenas != NULL){
+        int home = homeArena(pool);
+        if (pool->flags & MEM_REMOTE_FREE){
+            size = remoteFreeSize(size);
+        }
+        for (i = 0; i < pool->arenaCount && count < n; i++){
+            mem_pool_t *arena = pool->arenas[(home + i) % pool->arenaCount];
+            drainRemoteFrees(arena);
+            count += mem_pool_malloc_batch(arena, size, out + count, n - count);
+        }
+    } else if (pool->flags & MEM_THREAD_CACHE){
+        //The caches already take blocks from the pool in batches
+        while (count < n && (out[count] = cacheMalloc(pool, size)) != NULL){
+            count++;
+        }
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        count = centralMallocBatch(pool, size, out, n);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    for (i = count; i < n; i++){
+        out[i] = NULL;
+    }
+    return count;
+}
+
+/**
+ Frees n blocks at once. ptrs is sorted by address in place, so blocks
+ that lie next to each other are merged with each other in one go.
+ */
+void mem_pool_free_batch(mem_pool_t *pool, void **ptrs, int n)
+{
+    int i;
+
+    if (n <= 0){
+        return;
+    }
+    qsort(ptrs, n, sizeof(void *), compareAddresses);
+    if (pool->arenas != NULL){
+        //Sorted, the blocks of each arena are next to each other
+        for (i = 0; i < n; ){
+            mem_pool_t *arena = arenaOf(pool, ptrs[i]);
+            int j = i + 1;
+            while (j < n && arenaOf(pool, ptrs[j]) == arena){
+                j++;
+            }
+            if (arena == NULL || (pool->flags & MEM_REMOTE_FREE && arena != pool->arenas[homeArena(pool)])){
+                for (; i < j; i++){
+                    mem_pool_free(pool, ptrs[i]);
+                }
+            } else {
+                mem_pool_free_batch(arena, ptrs + i, j - i);
+            }
+            i = j;
+        }
+        return;
+    }
+    if (pool->flags & MEM_THREAD_CACHE){
+        for (i = 0; i < n; i++){
+            cacheFree(pool, ptrs[i]);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS || pool->strategy == Buddy || pool->strategy == Bitmap){
+        for (i = 0; i < n; i++){
+            centralFree(pool, ptrs[i]);
+        }
+    } else {
+        listFreeBatch(pool, ptrs, n);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int compareAddresses(const void *a, const void *b){
+    uintptr_t first = (uintptr_t)*(void * const *)a;
+    uintptr_t second = (uintptr_t)*(void * const *)b;
+    return first < second ? -1 : first > second;
+}
+
+/**
+ Changes the size of a block to requested bytes, keeping its contents up to
+ the smaller of the two sizes. The block shrinks in place, and grows in
+ place into free memory right after it if there is enough; only otherwise
+ is it moved. Returns the block's new address, or NULL if no memory could
+ be found, in which case the block is left as it was. A handle block
+ (mem_pool_malloc_handle()) is only resized in place, as its handle would
+ not follow it. A NULL block is allocated; a size of 0 frees the block and
+ returns NULL.
+ */
+void *mem_pool_realloc(mem_pool_t *pool, void *block, size_t requested)
+{
+    mem_pool_t *owner = pool;
+    void *start = block;
+    size_t offset = 0;
+    size_t oldSize;
+    int cached;
+    void *moved;
+
+    if (block == NULL){
+        return mem_pool_malloc(pool, requested);
+    }
+    if (requested == 0){
+        mem_pool_free(pool, block);
+        return NULL;
+    }
+    if (block < pool->memory || (char *)block >= (char *)pool->memory + pool->size){
+        if (debugMessages){
+            printf("Myrealloc didn't find the node it was looking for\n");
+        }
+        return NULL;
+    }
+    if (pool->arenas != NULL){
+        owner = arenaOf(pool, block);
+        if (pool->flags & MEM_REMOTE_FREE){
+            requested = remoteFreeSize(requested);
+        }
+    }
+    //Handle blocks skip the thread caches, so they have no header to read
+    cached = owner->flags & MEM_THREAD_CACHE && !isHandleBlock(owner, block);
+    if (cached && *(size_t *)((char *)block - CACHE_HEADER) < CACHE_CLASSES){
+        //Cached blocks keep the size of their class
+        oldSize = (*(size_t *)((char *)block - CACHE_HEADER) + 1) * 16;
+        if (requested <= oldSize){
+            return block;
+        }
+    } else {
+        if (cached){
+            //Other blocks are resized in the pool, header included
+            start = cacheBlockStart(block);
+            offset = (char *)block - (char *)start;
+        }
+        pthread_mutex_lock(&owner->lock);
+        if (centralResize(owner, start, requested + offset)){
+            pthread_mutex_unlock(&owner->lock);
+            return block;
+        }
+        oldSize = centralBlockSize(owner, start);
+        pthread_mutex_unlock(&owner->lock);
+        if (oldSize == 0){
+            return NULL; //Not an allocated block, or one only mem_pool_compact() may move
+        }
+        oldSize -= offset;
+    }
+
+    moved = mem_pool_malloc(pool, requested);
+    if (moved == NULL){
+        return NULL;
+    }
+    memcpy(moved, block, oldSize < requested ? oldSize : requested);
+    mem_pool_free(pool, block);
+    return moved;
+}
+
+/**
+ mem_pool_malloc_aligned() without the thread caches. The caller holds pool->lock.
+ */
+void *centralMalloc(mem_pool_t *pool, size_t alignment, size_t requested)
+{
+    if (pool->flags & MEM_SMALL_SLABS && requested <= SLAB_MAX_SIZE && alignment <= 16){
+        return slabMalloc(pool, requested);
+    }
+    return poolMalloc(pool, alignment, requested);
+}
+
+/**
+ Allocates a block of its own, never one from a slab. The caller holds pool->lock.
+ */
+void *poolMalloc(mem_pool_t *pool, size_t alignment, size_t requested)
+{
+    void *ptr = strategyMalloc(pool, alignment, requested);
+
+    //A growable pool commits more of its reservation until the block fits
+    while (ptr == NULL && pool->flags & MEM_GROWABLE && growPool(pool, requested + alignment)){
+        ptr = strategyMalloc(pool, alignment, requested);
+    }
+    if (ptr == NULL && debugMessages) {
+        printf("Didn't find suitable memory in mymalloc()\n");
+    }
+    return ptr;
+}
+
+/**
+ Allocates a block from the memory the pool has now. The caller holds pool->lock.
+ */
+void *strategyMalloc(mem_pool_t *pool, size_t alignment, size_t requested)
+{
+    void *ptr = NULL;
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        return alignment > TAG_ALIGN ? tagMallocAligned(pool, alignment, requested) : tagMalloc(pool, requested);
+    }
+    switch (pool->strategy)
     {
+        case NotSet:
+            break;
+        case First:
+            ptr = malloc_first(pool, alignment, requested);
+            break;
         case Best:
-            return "best";
+            ptr = malloc_best(pool, alignment, requested);
+            break;
         case Worst:
-            return "worst";
-        case First:
-            return "first";
+            ptr = malloc_worst(pool, alignment, requested);
+            break;
         case Next:
-            return "next";
-        default:
-            return "unknown";
+            ptr = malloc_next(pool, alignment, requested);
+            break;
+        case Tlsf:
+            ptr = malloc_tlsf(pool, alignment, requested);
+            break;
+        case Buddy:
+            ptr = malloc_buddy(pool, alignment, requested);
+            break;
+        case Bitmap:
+            ptr = malloc_bitmap(pool, alignment, requested);
+            break;
     }
+    return ptr;
 }
 
-// Get strategy from name.
-strategies strategyFromString(char * strategy)
+
+/**
+ mem_pool_free() without the thread caches. The caller holds pool->lock.
+ */
+void centralFree(mem_pool_t *pool, void* block)
 {
-    if (!strcmp(strategy,"best"))
-    {
-        return Best;
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        tagFree(pool, block);
+        return;
     }
-    else if (!strcmp(strategy,"worst"))
-    {
-        return Worst;
+    struct memoryList *node = allocTableFind(pool, block);
+
+    if (node == NULL && pool->flags & MEM_SMALL_SLABS && slabFree(pool, block)){
+        return;
     }
-    else if (!strcmp(strategy,"first"))
-    {
-        return First;
+    if (node && node->slab){
+        node = NULL; //The start of a slab is never handed out
+    }
+    if (node && node->handle != 0){
+        if (debugMessages){
+            printf("Myfree was given a handle block; use myfree_handle()\n");
+        }
+        return;
+    }
+    if (node && pool->strategy == Buddy){
+        buddyFreeNode(pool, node);
+        return;
+    }
+    if (node){
+        freeNode(pool, node);
+        return;
+    }
+    if (debugMessages){
+        printf("Myfree didn't find the node it was looking for\n");
+    }
+}
+
+/****** Memory status/property functions ******
+ * Implement these functions.
+ * Note that when refered to "memory" here, it is meant that the
+ * memory pool this module manages via initmem/mymalloc/myfree.
+ */
+
+/* Get the number of contiguous areas of free space in memory. */
+int mem_pool_holes(mem_pool_t *pool)
+{
+    int total;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        return arenaSum(pool, mem_pool_holes);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        total = tagPool(pool)->holes;
+    } else {
+        CHECK_TOTAL(pool->holeCount, scanHoles);
+        if (pool->granules != NULL){
+            CHECK_TOTAL(pool->holeCount, granuleHoles);
+        }
+        total = pool->holeCount;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return total;
+}
+
+/* Get the number of bytes allocated.
+ * With MEM_BOUNDARY_TAGS this is the usable payload of the allocated blocks
+ * (requests rounded up to 16 bytes), not counting their tags.
+ */
+int mem_pool_allocated(mem_pool_t *pool)
+{
+    int total;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        return arenaSum(pool, mem_pool_allocated);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        total = tagPool(pool)->allocated;
+    } else {
+        CHECK_TOTAL(pool->allocatedBytes, scanAllocated);
+        if (pool->granules != NULL){
+            CHECK_TOTAL(pool->allocatedBytes, granuleAllocated);
+        }
+        total = pool->allocatedBytes;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return total;
+}
+
+/* Number of non-allocated bytes.
+ * With MEM_BOUNDARY_TAGS this is what the free blocks could hold,
+ * i.e. their size minus the tags.
+ */
+int mem_pool_free_bytes(mem_pool_t *pool)
+{
+    int total;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        return arenaSum(pool, mem_pool_free_bytes);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        total = tagPool(pool)->free;
+    } else {
+        CHECK_TOTAL(pool->freeBytes, scanFree);
+        total = pool->freeBytes;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return total;
+}
+
+/* Number of bytes in the largest contiguous area of unallocated memory */
+int mem_pool_largest_free(mem_pool_t *pool)
+{
+    int largest = 0;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        int i;
+        for (i = 0; i < pool->arenaCount; i++){
+            int arenaLargest = mem_pool_largest_free(pool->arenas[i]);
+            largest = arenaLargest > largest ? arenaLargest : largest;
+        }
+        return largest;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        largest = tagLargestFree(pool);
+    } else if (keepsFreeList(pool)){
+        if (pool->freeByAddress.root){
+            largest = nodeFromLink(pool->freeByAddress.root, byFreeAddress)->maxFreeBelow;
+        }
+        CHECK_TOTAL(largest, scanLargestFree);
+    } else if (keepsHeap(pool)){
+        if (pool->freeHeapCount > 0){
+            largest = pool->freeHeap[0]->size;
+        }
+    } else if (keepsSizeClasses(pool)){
+        largest = tlsfLargestFree(pool);
+        CHECK_TOTAL(largest, scanLargestFree);
+    } else if (pool->freeBySize.root){
+        //The largest node is the rightmost one
+        struct memTreeLink *link = pool->freeBySize.root;
+        while (link->right != NULL){
+            link = link->right;
+        }
+        largest = nodeFromLink(link, bySize)->size;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return largest;
+}
+
+/* Number of free blocks smaller than "size" bytes. */
+int mem_pool_small_free(mem_pool_t *pool, int size)
+{
+    int numOfSmallFree = 0;
+    struct memTreeLink *link;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        int i;
+        for (i = 0; i < pool->arenaCount; i++){
+            numOfSmallFree += mem_pool_small_free(pool->arenas[i], size);
+        }
+        return numOfSmallFree;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        numOfSmallFree = tagSmallFree(pool, size);
+        pthread_mutex_unlock(&pool->lock);
+        return numOfSmallFree;
+    }
+    if (keepsSizeClasses(pool)){
+        numOfSmallFree = tlsfSmallFree(pool, size);
+        pthread_mutex_unlock(&pool->lock);
+        return numOfSmallFree;
+    }
+    //Count the nodes of freeBySize that are ordered before any node larger than size
+    link = pool->freeBySize.root;
+    while (link){
+        if (size >= 0 && nodeFromLink(link, bySize)->size <= (size_t)size){
+            numOfSmallFree += treeCount(link->left) + 1;
+            link = link->right;
+        } else {
+            link = link->left;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return numOfSmallFree;
+}
+
+/* Number of free blocks in each power-of-two size range.
+ * counts[k] is the number of free blocks with 2^k <= size < 2^(k+1);
+ * counts[0] also holds any empty holes, such as the one a 0 byte pool
+ * starts with. The last of the "buckets" entries also counts every larger block.
+ * Returns the number of entries needed to hold the whole distribution.
+ */
+int mem_pool_free_histogram(mem_pool_t *pool, int *counts, int buckets)
+{
+    int used = 0;
+    int k;
+
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        int *arenaCounts = (int *)malloc((buckets > 0 ? buckets : 1) * sizeof(int));
+        int i;
+        for (k = 0; k < buckets; k++){
+            counts[k] = 0;
+        }
+        for (i = 0; i < pool->arenaCount; i++){
+            int arenaUsed = mem_pool_free_histogram(pool->arenas[i], arenaCounts, buckets);
+            used = arenaUsed > used ? arenaUsed : used;
+            for (k = 0; k < buckets; k++){
+                counts[k] += arenaCounts[k];
+            }
+        }
+        free(arenaCounts);
+        return used;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        used = tagFreeHistogram(pool, counts, buckets);
+        pthread_mutex_unlock(&pool->lock);
+        return used;
+    }
+    for (k = 0; k < buckets; k++){
+        counts[k] = 0;
+    }
+    for (k = 0; k < 64; k++){
+        if (pool->freeHistogram[k] == 0){
+            continue;
+        }
+        used = k + 1;
+        if (buckets > 0){
+            counts[k < buckets ? k : buckets - 1] += pool->freeHistogram[k];
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return used;
+}
+
+char mem_pool_is_alloc(mem_pool_t *pool, void *ptr)
+{
+    struct memoryList *found;
+    char alloc;
+
+    if (ptr < pool->memory || (char *)ptr >= (char *)pool->memory + pool->size){
+        return 0;
+    }
+    if (pool->arenas != NULL){
+        drainRemoteFrees(arenaOf(pool, ptr));
+        return mem_pool_is_alloc(arenaOf(pool, ptr), ptr);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        alloc = tagIsAllocAt(pool, ptr);
+        pthread_mutex_unlock(&pool->lock);
+        return alloc;
+    }
+    if (pool->granules != NULL && !(pool->flags & MEM_SMALL_SLABS)){
+        //One bit, without walking the nodes; slabs need their node for the slot bit
+        alloc = granuleTest(pool, ptr);
+        pthread_mutex_unlock(&pool->lock);
+        return alloc;
+    }
+    found = nodeHolding(pool, ptr);
+    alloc = found ? found->alloc : 0;
+    if (found && found->slab){
+        //Only the bytes of the allocated blocks of the slab count
+        int index = slabIndex((struct slab *)found->ptr, ptr);
+        alloc = index >= 0 && ((struct slab *)found->ptr)->bitmap[index / 64] >> (index % 64) & 1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return alloc;
+}
+/* Bytes of the pool that can never be handed out: with MEM_BOUNDARY_TAGS,
+ * the pool header, every block's tags and the alignment padding.
+ * mem_allocated() + mem_free() + mem_overhead() == mem_total().
+ * List nodes live outside the pool, so without tags this is 0.
+ */
+int mem_pool_overhead(mem_pool_t *pool)
+{
+    int overhead = 0;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        return arenaSum(pool, mem_pool_overhead);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        overhead = pool->size - tagPool(pool)->allocated - tagPool(pool)->free;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return overhead;
+}
+
+/* Bytes handed out beyond what was asked for: Buddy rounds every
+ * request up to a power of two, and Bitmap up to whole granules. The
+ * other strategies give exactly the
+ * requested size from list nodes, so this is 0 for them, and it is not
+ * tracked with MEM_BOUNDARY_TAGS or MEM_THREAD_CACHE.
+ */
+int mem_pool_internal_fragmentation(mem_pool_t *pool)
+{
+    int internal = 0;
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        return arenaSum(pool, mem_pool_internal_fragmentation);
+    }
+    pthread_mutex_lock(&pool->lock);
+    if ((pool->strategy == Buddy || pool->strategy == Bitmap) && !(pool->flags & MEM_BOUNDARY_TAGS)){
+        internal = pool->allocatedBytes - pool->requestedBytes;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return internal;
+}
+
+/* How badly the free memory is split up, from 0 (all free bytes in one
+ * block, or nothing free) towards 1: 1 - largest free block / free bytes.
+ */
+double mem_pool_external_fragmentation(mem_pool_t *pool)
+{
+    int free = mem_pool_free_bytes(pool);
+    if (free == 0){
+        return 0;
+    }
+    return 1.0 - (double)mem_pool_largest_free(pool) / free;
+}
+
+/*
+ * Scanning versions of mem_holes(), mem_allocated(), mem_free() and mem_largest_free().
+ * Only used to cross-check the running totals in MYMEM_DEBUG builds.
+ */
+int scanHoles(mem_pool_t *pool)
+{
+    int holes = 0;
+    struct memoryList *node = pool->head;
+    while (node){
+        if (node->alloc == 0){
+            holes++;
+        }
+        node = node->next;
+    }
+    return holes;
+}
+
+int scanAllocated(mem_pool_t *pool)
+{
+    int bytesAllocated = 0;
+    struct memoryList *node = pool->head;
+    while (node){
+        if (node->alloc == 1){
+            bytesAllocated += node->size;
+        }
+        node = node->next;
+    }
+    return bytesAllocated;
+}
+
+int scanFree(mem_pool_t *pool)
+{
+    int bytesFree = 0;
+    struct memoryList *node = pool->head;
+    while (node){
+        if (node->alloc == 0){
+            bytesFree += node->size;
+        }
+        node = node->next;
+    }
+    return bytesFree;
+}
+
+int scanLargestFree(mem_pool_t *pool)
+{
+    int largest = 0;
+    struct memoryList *node = pool->head;
+    while (node){
+        if (node->alloc == 0 && (int)node->size > largest){
+            largest = node->size;
+        }
+        node = node->next;
+    }
+    return largest;
+}
+
+//-------------------Default pool------------------------------------------
+/*
+ * The original single-pool interface. Each function works on defaultPool,
+ * which initmem() replaces.
+ */
+
+void initmem(strategies strategy, size_t sz)
+{
+    initmem_flags(strategy, sz, 0);
+}
+
+/**
+ Like initmem(), with MEM_* flags choosing how the pool is managed
+ */
+void initmem_flags(strategies strategy, size_t sz, int flags)
+{
+    initmem_arenas(strategy, sz, flags, 1);
+}
+
+/**
+ Makes the pool in the file at path the default pool; see mem_pool_open_file().
+ Returns 1 if the file already held a pool, 0 if a new one was made, -1 on error.
+ */
+int initmem_file(const char *path, strategies strategy, size_t sz)
+{
+    int reopened = 0;
+    mem_pool_destroy(defaultPool);
+    defaultPool = mem_pool_open_file(path, strategy, sz, &reopened);
+    return defaultPool == NULL ? -1 : reopened;
+}
+
+/**
+ Like initmem_flags(), with the memory split into independently locked arenas
+ */
+void initmem_arenas(strategies strategy, size_t sz, int flags, int arenas)
+{
+    /* release any other memory you were using for bookkeeping when doing a re-initialization! */
+    mem_pool_destroy(defaultPool);
+    defaultPool = mem_pool_create_arenas(strategy, sz, flags, arenas);
+}
+
+/**
+ Allocate a block of memory with the requested size.
+ If the requested block is not available, mymalloc returns NULL.
+ Otherwise, it returns a pointer to the newly allocated block.
+ Restriction: requested >= 1
+ */
+void *mymalloc(size_t requested)
+{
+    return mem_pool_malloc(defaultPool, requested);
+}
+
+/**
+ Like mymalloc(), with the block's address a multiple of alignment,
+ which must be a power of two
+ */
+void *mymalloc_aligned(size_t alignment, size_t size)
+{
+    return mem_pool_malloc_aligned(defaultPool, alignment, size);
+}
+
+/* Frees a block of memory previously allocated by mymalloc. */
+void myfree(void* block)
+{
+    mem_pool_free(defaultPool, block);
+}
+
+/**
+ Allocates n blocks of size bytes into out with one search.
+ Returns how many could be allocated.
+ */
+int mymalloc_batch(size_t size, void **out, int n)
+{
+    return mem_pool_malloc_batch(defaultPool, size, out, n);
+}
+
+/* Frees n blocks previously allocated by mymalloc. Sorts ptrs. */
+void myfree_batch(void **ptrs, int n)
+{
+    mem_pool_free_batch(defaultPool, ptrs, n);
+}
+
+/**
+ Changes the size of a block previously allocated by mymalloc, moving it
+ only if it can't be resized where it is. Returns its new address.
+ */
+void *myrealloc(void *block, size_t requested)
+{
+    return mem_pool_realloc(defaultPool, block, requested);
+}
+
+/* Get the number of contiguous areas of free space in memory. */
+int mem_holes()
+{
+    return mem_pool_holes(defaultPool);
+}
+
+/* Get the number of bytes allocated */
+int mem_allocated()
+{
+    return mem_pool_allocated(defaultPool);
+}
+
+/* Number of non-allocated bytes */
+int mem_free()
+{
+    return mem_pool_free_bytes(defaultPool);
+}
+
+/* Number of bytes in the largest contiguous area of unallocated memory */
+int mem_largest_free()
+{
+    return mem_pool_largest_free(defaultPool);
+}
+
+/* Number of free blocks smaller than "size" bytes. */
+int mem_small_free(int size)
+{
+    return mem_pool_small_free(defaultPool, size);
+}
+
+int mem_free_histogram(int *counts, int buckets)
+{
+    return mem_pool_free_histogram(defaultPool, counts, buckets);
+}
+
+char mem_is_alloc(void *ptr)
+{
+    return mem_pool_is_alloc(defaultPool, ptr);
+}
+
+int mem_overhead()
+{
+    return mem_pool_overhead(defaultPool);
+}
+
+int mem_internal_fragmentation()
+{
+    return mem_pool_internal_fragmentation(defaultPool);
+}
+
+double mem_external_fragmentation()
+{
+    return mem_pool_external_fragmentation(defaultPool);
+}
+
+/* Gives the blocks this thread has cached back to the pool */
+void mem_flush_cache()
+{
+    mem_pool_flush_cache(defaultPool);
+}
+
+void mem_set_root(void *block)
+{
+    mem_pool_set_root(defaultPool, block);
+}
+
+void *mem_root()
+{
+    return mem_pool_root(defaultPool);
+}
+
+mem_handle_t mymalloc_handle(size_t requested)
+{
+    return mem_pool_malloc_handle(defaultPool, requested);
+}
+
+void *mem_deref(mem_handle_t handle)
+{
+    return mem_pool_deref(defaultPool, handle);
+}
+
+void myfree_handle(mem_handle_t handle)
+{
+    mem_pool_free_handle(defaultPool, handle);
+}
+
+/* Moves handle blocks together, for at most budget bytes of work per call */
+int mem_compact(size_t budget)
+{
+    return mem_pool_compact(defaultPool, budget);
+}
+
+/* Gives the free tail of a MEM_GROWABLE pool back to the OS */
+size_t mem_trim()
+{
+    return mem_pool_trim(defaultPool);
+}
+
+/* Use this function to print out the current contents of memory. */
+void print_memory()
+{
+    mem_pool_print(defaultPool);
+}
+
+/*
+ * Feel free to use these functions, but do not modify them.
+ * The test code uses them, but you may find them useful.
+ */
+
+
+//Returns a pointer to the memory pool.
+void *mem_pool()
+{
+    return defaultPool ? mem_pool_base(defaultPool) : NULL;
+}
+
+// Returns the total number of bytes in the memory pool. */
+int mem_total()
+{
+    return defaultPool ? mem_pool_total(defaultPool) : 0;
+}
+
+//Returns a pointer to the memory of a pool.
+void *mem_pool_base(mem_pool_t *pool)
+{
+    return pool->memory;
+}
+
+// Returns the total number of bytes in a pool.
+int mem_pool_total(mem_pool_t *pool)
+{
+    return pool->size;
+}
+
+
+// Get string name for a strategy.
+char *strategy_name(strategies strategy)
+{
+    switch (strategy)
+    {
+        case Best:
+            return "best";
+        case Worst:
+            return "worst";
+        case First:
+            return "first";
+        case Next:
+            return "next";
+        case Tlsf:
+            return "tlsf";
+        case Buddy:
+            return "buddy";
+        case Bitmap:
+            return "bitmap";
+        default:
+            return "unknown";
+    }
+}
+
+// Get strategy from name.
+strategies strategyFromString(char * strategy)
+{
+    if (!strcmp(strategy,"best"))
+    {
+        return Best;
+    }
+    else if (!strcmp(strategy,"worst"))
+    {
+        return Worst;
+    }
+    else if (!strcmp(strategy,"first"))
+    {
+        return First;
+    }
+    else if (!strcmp(strategy,"next"))
+    {
+        return Next;
+    }
+    else if (!strcmp(strategy,"tlsf"))
+    {
+        return Tlsf;
+    }
+    else if (!strcmp(strategy,"buddy"))
+    {
+        return Buddy;
+    }
+    else if (!strcmp(strategy,"bitmap"))
+    {
+        return Bitmap;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+
+/*
+ * These functions are for you to modify however you see fit.  These will not
+ * be used in tests, but you may find them useful for debugging.
+ */
+
+void printNode(struct memoryList *node)
+{
+    printf("Node{\nNext: %p\nLast: %p\nSize: %zu\nAlloc: %d\nPtr: %p\n}\n",node->next,node->last,node->size,node->alloc,node->ptr);
+}
+
+/* Print out the current contents of a pool. */
+void mem_pool_print(mem_pool_t *pool)
+{
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        int i;
+        for (i = 0; i < pool->arenaCount; i++){
+            printf("Arena %d:\n", i);
+            mem_pool_print(pool->arenas[i]);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        tagPrintMemory(pool);
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    struct memoryList *currentNode = pool->head;
+    while (currentNode != NULL){
+        //Print the node
+        printNode(currentNode);
+        //update
+        currentNode = currentNode->next;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+
+/**
+ Use this function to track memory allocation performance.
+ This function does not depend on your implementation,
+ but on the functions you wrote above.
+ */
+void print_memory_status()
+{
+    printf("%d out of %d bytes allocated.\n",mem_allocated(),mem_total());
+    printf("%d bytes are free in %d holes; maximum allocatable block is %d bytes.\n",mem_free(),mem_holes(),mem_largest_free());
+    printf("Average hole size is %f.\n\n",((float)mem_free())/mem_holes());
+}
+
+/**
+ Use this function to see what happens when your malloc and free
+ implementations are called.  Run "mem -try <args>" to call this function.
+ We have given you a simple example to start.
+ */
+void try_mymem(int argc, char **argv) {
+    strategies strat;
+    void *a, *b, *c, *d, *e;
+    if(argc > 1)
+        strat = strategyFromString(argv[1]);
+    else
+        strat = Worst;
+
+
+    /* A simple example.
+       Each algorithm should produce a different layout. */
+    initmem(strat,500);
+
+    a = mymalloc(100);
+    b = mymalloc(100);
+    c = mymalloc(100);
+    myfree(b);
+    d = mymalloc(50);
+    myfree(a);
+    e = mymalloc(25);
+
+}
+
+//------------------------Utility functions---------------------------------
+/**
+Inserts newNode after oldNode
+Doesnt change memory allocation.
+ */
+void insertNodeAfter(mem_pool_t *pool, struct memoryList *oldNode, struct memoryList *newNode ){
+    newNode->next = oldNode->next;
+    newNode->last = oldNode;
+    oldNode->next = newNode;
+    if (newNode->next){
+        newNode->next->last = newNode;
+    }
+    addressInsert(pool, newNode);
+}
+
+/**
+ The node is de-alloced.
+ Node is merged with any surrounding free nodes
+ */
+void freeNode(mem_pool_t *pool, struct memoryList *node){
+    if (pool->granules != NULL){
+        granuleMark(pool, node->ptr, node->size, 0);
+        pool->requestedBytes -= node->requested;
+    }
+    // Mark that this node is no longer allocated
+    allocTableRemove(pool, node);
+    pool->allocatedBytes -= node->size;
+    node->alloc = 0;
+
+    //Check if it should be merged with "left" neighbor
+    int mergeLeft = node->last != NULL && node->last->alloc == 0;
+    int mergeRight = node->next != NULL && node->next->alloc == 0;
+
+    if (mergeLeft){
+        //Important: Update "node" to be the resulting node of the merge
+        //Otherwise we can't use it for merging to the right
+        node = mergeFreeNodes(pool, node->last,node);
+    }
+
+    //Check if it should be merged with "right" neighbor
+    if (mergeRight){
+        mergeFreeNodes(pool, node,node->next);
+    }
+
+    //Index the resulting free node once all merging is done
+    indexFreeNode(pool, node);
+    releaseHole(pool, node->ptr, node->size, 0, 0);
+}
+
+
+
+/**
+ Makes 2 free nodes into 1 free node of total size
+ The resulting node is the first/leftmost of the two
+ The 2 nodes should be neighbors and should both be free (not allocated)
+ Both nodes are taken out of the free indexes; the caller re-indexes the result
+ The address of the resulting node is returned
+ */
+struct memoryList *mergeFreeNodes(mem_pool_t *pool, struct memoryList *firstNode, struct memoryList *lastNode){
+    //Assert that firstNode and lastNode are indeed neighbors
+    if (firstNode->next != lastNode && lastNode->last != firstNode ){
+        printf("Error in mergeFreeNodes(). Nodes are not neighbors");
+        return NULL;
+    }
+    if (firstNode->alloc != 0 && lastNode->alloc != 0){
+        printf("Error in mergeFreeNodes(). Nodes are not not free");
+        return NULL;
+    }
+    //A node that was just freed takes over the place of its right neighbor in the free list
+    if (isFreeListed(lastNode) && !isFreeListed(firstNode)){
+        freeListReplace(pool, lastNode, firstNode);
+    }
+    //The size of both nodes changes, so they can't stay in the indexes
+    if (isFreeIndexed(firstNode)){
+        unindexFreeNode(pool, firstNode);
+    }
+    if (isFreeIndexed(lastNode)){
+        unindexFreeNode(pool, lastNode);
+    }
+
+    //Calculate new size
+    size_t newSize = firstNode->size + lastNode->size;
+
+    //Remove the last node
+    removeNode(pool, lastNode);
+
+    //Update first node (ptr doesn't need to be updated)
+    firstNode->size = newSize; //Set new size
+
+    //Return resulting node
+    return firstNode;
+}
+
+/**
+ Removes the node from the list and frees it
+ Only free nodes are removed (when merging), so the node is never in allocTable
+ */
+void removeNode(mem_pool_t *pool, struct memoryList *node){
+    struct memoryList *myLast = node->last;
+    struct memoryList *myNext = node->next;
+
+    if (isFreeListed(node)){
+        freeListRemove(pool, node);
+    }
+
+    //If node is head, make head point to next node
+    if (node == pool->head){
+        //This should never happen since we always remove the right node when we merge
+        printf("Removing head node\n");
+        pool->head = pool->head->next;
+        if (pool->head == NULL){
+            printf("ERROR in deleting head\n");
+        }
+    } else if (node == pool->lastVisited){
+        //If node is lastVisited, update to left neighbor, since it will have same right neighbor now
+        pool->lastVisited = pool->lastVisited->last;
+        if (pool->lastVisited == NULL){
+            printf("ERROR in deleting lastVisited\n");
+        } else {
+            setLastVisited(pool, pool->lastVisited); //Moves the rover along
+        }
+    }
+
+
+    //Before unlinking, as startTable may hand its entry on to the next node
+    addressRemove(pool, node);
+
+    //Make last point to next
+    if (myLast){ //NULL pointer check
+        myLast->next = myNext;
+    }
+
+    //Make next point to last
+    if (myNext){ //NULL pointer check
+        myNext->last = myLast;
+    }
+
+    //Free node
+    recycleNode(pool, node);
+}
+
+/**
+ Either alloc's directly on the node (if size fits excactly)
+ Or splits into two nodes, allocating on the first one
+ */
+void *allocOnNode(mem_pool_t *pool, struct memoryList *node, size_t requested){
+    if (node->size == requested){ //If size fits excactly
+        unindexFreeNode(pool, node);
+        if (isFreeListed(node)){
+            freeListRemove(pool, node);
+        }
+        node->alloc = 1;
+        allocTableInsert(pool, node);
+    } else { //requested < node->size
+        //Create new node for remaining space
+        size_t remainingSize = node->size - requested;
+        void *remainingMemory = node->ptr + requested;
+        struct memoryList *remainingNode = newNode(pool);
+        if (remainingNode == NULL){
+            printf("MALLOC ERROR!\n)");
+            return NULL;
+        }
+        remainingNode->last = NULL;
+        remainingNode->next = NULL;
+        remainingNode->size = remainingSize;
+        remainingNode->alloc = 0;
+        remainingNode->ptr = remainingMemory;
+        if (isFreeListed(node)){
+            //The remaining node takes over the place of node by address
+            freeListReplace(pool, node, remainingNode);
+        }
+        unindexFreeNode(pool, node);
+        insertNodeAfter(pool, node,remainingNode);
+        indexFreeNode(pool, remainingNode);
+
+        //Update node
+        node->alloc = 1;
+        node->size = requested;
+        allocTableInsert(pool, node);
+
+    }
+    pool->allocatedBytes += requested;
+    return node->ptr;
+}
+
+//-------------------Malloc functions--------------------------------------
+/*
+ * Each strategy takes an alignment (1 for none). A free node fits when it
+ * holds the requested bytes after skipping alignPadding() bytes to the
+ * first aligned address; allocAlignedOnNode() keeps those skipped bytes
+ * as a free node of their own.
+ */
+void *malloc_first(mem_pool_t *pool, size_t alignment, size_t requested){
+    //Lowest free node that fits
+    struct memoryList *firstFit = lowestFreeFitting(pool->freeByAddress.root, alignment, requested);
+
+    if (firstFit == NULL){
+        return NULL;
+    }
+    setLastVisited(pool, firstFit);
+    return allocAlignedOnNode(pool, firstFit, alignment, requested);
+}
+
+void *malloc_best(mem_pool_t *pool, size_t alignment, size_t requested){
+    //Smallest free node that fits; the lowest address wins a tie
+    struct memoryList *bestFit = alignment > 1
+        ? smallestFreeFittingAligned(pool->freeBySize.root, alignment, requested)
+        : smallestFreeFitting(pool, requested);
+
+    if (bestFit == NULL){
+        return NULL;
+    }
+    setLastVisited(pool, bestFit);
+    return allocAlignedOnNode(pool, bestFit, alignment, requested);
+}
+
+
+void *malloc_next(mem_pool_t *pool, size_t alignment, size_t requested){
+    struct memoryList *startNode = pool->rover;//The node that we started on
+    struct memoryList *node = pool->rover;//The node that we use as iterator
+
+    if (node == NULL){
+        return NULL; //No free node at all
+    }
+    //One whole loop around the free list, from the first free node after lastVisited
+    do
+    {
+        //If node is big enough
+        if (node->size >= requested && node->size - requested >= alignPadding(node->ptr, alignment)){
+            setLastVisited(pool, node);
+            return allocAlignedOnNode(pool, node, alignment, requested);
+        }
+        node = node->freeNext ? node->freeNext : pool->freeHead;
+    } while (node != startNode);
+
+    return NULL;
+}
+
+void *malloc_worst(mem_pool_t *pool, size_t alignment, size_t requested){
+    //The largest free node is on top of the heap; if it doesn't fit, nothing does
+    struct memoryList *worstFit = pool->freeHeapCount > 0 ? pool->freeHeap[0] : NULL;
+
+    if (worstFit == NULL || worstFit->size < requested){
+        return NULL;
+    }
+    if (worstFit->size - requested < alignPadding(worstFit->ptr, alignment)){
+        //Too little room after aligning; a smaller node may still fit
+        worstFit = largestFreeFittingAligned(pool->freeBySize.root, alignment, requested);
+        if (worstFit == NULL){
+            return NULL;
+        }
+    }
+    setLastVisited(pool, worstFit);
+    return allocAlignedOnNode(pool, worstFit, alignment, requested);
+}
+
+void *malloc_tlsf(mem_pool_t *pool, size_t alignment, size_t requested){
+    //Every node in the class found is big enough, so take the first one.
+    //Asking for alignment - 1 more bytes keeps that true after aligning.
+    struct memoryList *goodFit = tlsfFindFitting(pool, requested + alignment - 1);
+
+    if (goodFit == NULL){
+        return NULL;
+    }
+    setLastVisited(pool, goodFit);
+    return allocAlignedOnNode(pool, goodFit, alignment, requested);
+}
+
+void *malloc_buddy(mem_pool_t *pool, size_t alignment, size_t requested){
+    size_t size = 1;
+    struct memoryList *node;
+    void *ptr;
+
+    //A block is aligned to its size from the pool memory, so rounding up to the alignment aligns it
+    while (size < requested || size < alignment){
+        size <<= 1;
+    }
+    //Every free node is a power of two, so the smallest one that fits needs the fewest splits
+    node = smallestFreeFitting(pool, size);
+    if (node == NULL || alignPadding(node->ptr, alignment) != 0){
+        //Nothing free, or the pool memory itself is less aligned than asked for
+        return NULL;
+    }
+    unindexFreeNode(pool, node);
+    while (node->size > size){
+        if (!buddySplit(pool, node)){
+            indexFreeNode(pool, node);
+            return NULL;
+        }
+    }
+    indexFreeNode(pool, node);
+    setLastVisited(pool, node);
+    ptr = allocOnNode(pool, node, size);
+    if (ptr != NULL){
+        node->requested = requested;
+        pool->requestedBytes += requested;
+    }
+    return ptr;
+}
+
+/**
+ First fit, found in the granule bitmap instead of the free nodes. The
+ request is rounded up to whole granules; an aligned block looks for
+ enough extra granules to skip to the first aligned one.
+ */
+void *malloc_bitmap(mem_pool_t *pool, size_t alignment, size_t requested){
+    size_t count = granuleCount(requested > 0 ? requested : 1);
+    size_t extra = alignment > GRANULE_SIZE ? alignment / GRANULE_SIZE - 1 : 0;
+    size_t limit = pool->size / GRANULE_SIZE;
+    size_t found = granuleFind(pool, count + extra, limit);
+    struct memoryList *node;
+    void *ptr;
+
+    if (found == limit){
+        return NULL;
+    }
+    //The lowest run that fits starts where a hole does, so at a free node
+    node = nodeHolding(pool, (char *)pool->memory + found * GRANULE_SIZE);
+    setLastVisited(pool, node);
+    ptr = allocAlignedOnNode(pool, node, alignment, count * GRANULE_SIZE);
+    if (ptr != NULL){
+        granuleMark(pool, ptr, count * GRANULE_SIZE, 1);
+        allocTableFind(pool, ptr)->requested = requested;
+        pool->requestedBytes += requested;
+    }
+    return ptr;
+}
+
+/**
+ Bytes from ptr to the next address that is a multiple of alignment
+ */
+size_t alignPadding(void *ptr, size_t alignment){
+    return (size_t)(-(uintptr_t)ptr & (alignment - 1));
+}
+
+/**
+ Like allocOnNode(), but first splits off the bytes before the first
+ aligned address of the node as a free node of their own
+ */
+void *allocAlignedOnNode(mem_pool_t *pool, struct memoryList *node, size_t alignment, size_t requested){
+    size_t padding = alignPadding(node->ptr, alignment);
+
+    if (padding > 0){
+        struct memoryList *aligned = newNode(pool);
+        if (aligned == NULL){
+            return NULL;
+        }
+        unindexFreeNode(pool, node);
+        aligned->size = node->size - padding;
+        aligned->alloc = 0;
+        aligned->ptr = node->ptr + padding;
+        node->size = padding;
+        insertNodeAfter(pool, node, aligned);
+        indexFreeNode(pool, node);
+        indexFreeNode(pool, aligned);
+        if (pool->lastVisited == node){
+            setLastVisited(pool, aligned);
+        }
+        node = aligned;
+    }
+    return allocOnNode(pool, node, requested);
+}
+
+//-------------------Allocated node lookup---------------------------------
+/* Slots of allocTableOld moved by each insert. The new table is twice the
+ * size, so it takes at least old capacity / 2 inserts to fill it to the load
+ * where it grows again; moving 2 slots each empties the old table first.
+ */
+#define ALLOC_TABLE_MIGRATE_STEP 2
+
+/* Fills a slot of allocTableOld whose node was removed. Lookups in the old
+ * table go on past it; backward shifts could carry a node to a slot that
+ * allocTableMigrate() has passed already.
+ */
+struct memoryList allocTableRemoved;
+
+/**
+ Home slot of ptr in a table of 2^(64 - shift) slots (Fibonacci hashing of
+ the offset into the pool memory)
+ */
+size_t allocTableSlot(mem_pool_t *pool, void *ptr, int shift){
+    uint64_t offset = (uint64_t)((char *)ptr - (char *)pool->memory);
+    return (size_t)((offset * 11400714819323198485ull) >> shift);
+}
+
+/**
+ A zeroed table of capacity slots. Tables of a page or more get a mapping
+ of their own, which allocTableMigrate() can give back a page at a time.
+ */
+struct memoryList **allocTableAlloc(size_t capacity){
+    size_t bytes = capacity * sizeof(struct memoryList *);
+    void *table;
+
+    if (bytes < (size_t)sysconf(_SC_PAGESIZE)){
+        return (struct memoryList **)calloc(capacity, sizeof(struct memoryList *));
+    }
+    table = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return table == MAP_FAILED ? NULL : (struct memoryList **)table;
+}
+
+/**
+ Gives back a table from allocTableAlloc(), all but the pages before the
+ one holding slot from, which must have been unmapped already
+ */
+void allocTableRelease(struct memoryList **table, size_t capacity, size_t from){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = capacity * sizeof(struct memoryList *);
+    size_t start = from * sizeof(struct memoryList *) / page * page;
+
+    if (table == NULL){
+        return;
+    }
+    if (bytes < page){
+        free(table);
+    } else if (start < bytes){
+        munmap((char *)table + start, bytes - start);
+    }
+}
+
+/**
+ (Re)creates an empty table. Called by initmem().
+ */
+void allocTableInit(mem_pool_t *pool){
+    allocTableRelease(pool->allocTable, pool->allocTableCapacity, 0);
+    allocTableRelease(pool->allocTableOld, pool->allocTableCapacity / 2, pool->allocTableMoved);
+    pool->allocTableOld = NULL;
+    pool->allocTableCapacity = 64;
+    pool->allocTableShift = 64 - 6;
+    pool->allocTableCount = 0;
+    pool->allocTable = allocTableAlloc(pool->allocTableCapacity);
+}
+
+/**
+ Moves the nodes of up to slots slots of allocTableOld into allocTable,
+ and frees allocTableOld once all of them are done
+ */
+void allocTableMigrate(mem_pool_t *pool, size_t slots){
+    size_t oldCapacity = pool->allocTableCapacity / 2;
+    size_t mask = pool->allocTableCapacity - 1;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pageSlots = page / sizeof(struct memoryList *);
+
+    while (slots-- > 0 && pool->allocTableMoved < oldCapacity){
+        struct memoryList *node = pool->allocTableOld[pool->allocTableMoved++];
+        if (node != NULL && node != &allocTableRemoved){
+            size_t slot = allocTableSlot(pool, node->ptr, pool->allocTableShift);
+            while (pool->allocTable[slot]){
+                slot = (slot + 1) & mask;
+            }
+            pool->allocTable[slot] = node;
+        }
+        if (oldCapacity >= pageSlots && pool->allocTableMoved % pageSlots == 0){
+            //Unmapping the whole table at the end would cost as much as a rehash
+            munmap(pool->allocTableOld + pool->allocTableMoved - pageSlots, page);
+        }
+    }
+    if (pool->allocTableMoved == oldCapacity){
+        allocTableRelease(pool->allocTableOld, oldCapacity, oldCapacity);
+        pool->allocTableOld = NULL;
+    }
+}
+
+/**
+ Doubles the capacity. The nodes stay in the table being replaced, which
+ becomes allocTableOld, until allocTableMigrate() gets to them.
+ */
+void allocTableGrow(mem_pool_t *pool){
+    struct memoryList **table;
+
+    if (pool->allocTableOld != NULL){
+        allocTableMigrate(pool, SIZE_MAX); //Can't happen at ALLOC_TABLE_MIGRATE_STEP; see there
+    }
+    table = allocTableAlloc(pool->allocTableCapacity * 2);
+    if (table == NULL){
+        printf("MALLOC ERROR!\n");
+        exit(1);
+    }
+    pool->allocTableOld = pool->allocTable;
+    pool->allocTableMoved = 0;
+    pool->allocTable = table;
+    pool->allocTableCapacity *= 2;
+    pool->allocTableShift--;
+}
+
+/**
+ Adds an allocated node. The load factor is kept at or below 1/2.
+ */
+void allocTableInsert(mem_pool_t *pool, struct memoryList *node){
+    size_t mask;
+    size_t slot;
+
+    if (2 * (pool->allocTableCount + 1) > pool->allocTableCapacity){
+        allocTableGrow(pool);
+    }
+    mask = pool->allocTableCapacity - 1;
+    slot = allocTableSlot(pool, node->ptr, pool->allocTableShift);
+    while (pool->allocTable[slot]){
+        slot = (slot + 1) & mask;
+    }
+    pool->allocTable[slot] = node;
+    pool->allocTableCount++;
+    if (pool->allocTableOld != NULL){
+        allocTableMigrate(pool, ALLOC_TABLE_MIGRATE_STEP);
+    }
+}
+
+/**
+ The slot of allocTableOld holding the node starting at ptr, or NULL.
+ Slots before allocTableMoved are gone, and so is any node that was in
+ them, so the probe steps over them, also where it wraps around.
+ */
+struct memoryList **allocTableOldSlot(mem_pool_t *pool, void *ptr){
+    size_t capacity = pool->allocTableCapacity / 2;
+    size_t slot = allocTableSlot(pool, ptr, pool->allocTableShift + 1);
+    size_t left = capacity - pool->allocTableMoved; //Slots still there, each looked at once at most
+
+    for (; left > 0; left--){
+        if (slot < pool->allocTableMoved){
+            slot = pool->allocTableMoved;
+        }
+        if (pool->allocTableOld[slot] == NULL){
+            break;
+        }
+        if (pool->allocTableOld[slot]->ptr == ptr && pool->allocTableOld[slot] != &allocTableRemoved){
+            return &pool->allocTableOld[slot];
+        }
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return NULL;
+}
+
+/**
+ Returns the allocated node starting at ptr, or NULL if there is none
+ */
+struct memoryList *allocTableFind(mem_pool_t *pool, void *ptr){
+    size_t mask = pool->allocTableCapacity - 1;
+    size_t slot;
+    struct memoryList **oldSlot;
+
+    if (ptr < pool->memory || (char *)ptr >= (char *)pool->memory + pool->size){
+        return NULL;
+    }
+    slot = allocTableSlot(pool, ptr, pool->allocTableShift);
+    while (pool->allocTable[slot]){
+        if (pool->allocTable[slot]->ptr == ptr){
+            return pool->allocTable[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    oldSlot = pool->allocTableOld != NULL ? allocTableOldSlot(pool, ptr) : NULL;
+    return oldSlot != NULL ? *oldSlot : NULL;
+}
+
+/**
+ Removes an allocated node.
+ Uses backward-shift deletion, so no tombstones are left behind; only a
+ node still in allocTableOld leaves allocTableRemoved in its slot.
+ */
+void allocTableRemove(mem_pool_t *pool, struct memoryList *node){
+    size_t mask = pool->allocTableCapacity - 1;
+    size_t hole = allocTableSlot(pool, node->ptr, pool->allocTableShift);
+    size_t slot;
+
+    while (pool->allocTable[hole] != node){
+        if (pool->allocTable[hole] == NULL){
+            struct memoryList **oldSlot = pool->allocTableOld != NULL ? allocTableOldSlot(pool, node->ptr) : NULL;
+            if (oldSlot != NULL && *oldSlot == node){
+                *oldSlot = &allocTableRemoved;
+                pool->allocTableCount--;
+            }
+            return; //Not in the table
+        }
+        hole = (hole + 1) & mask;
+    }
+    pool->allocTable[hole] = NULL;
+    pool->allocTableCount--;
+
+    //Move later entries of the probe sequence back into the hole
+    slot = hole;
+    while (1){
+        size_t home;
+        slot = (slot + 1) & mask;
+        if (pool->allocTable[slot] == NULL){
+            break;
+        }
+        home = allocTableSlot(pool, pool->allocTable[slot]->ptr, pool->allocTableShift);
+        //Entry can move if its home is not cyclically in (hole, slot]
+        if (((slot - home) & mask) >= ((slot - hole) & mask)){
+            pool->allocTable[hole] = pool->allocTable[slot];
+            pool->allocTable[slot] = NULL;
+            hole = slot;
+        }
+    }
+}
+
+//-------------------Free node indexes-------------------------------------
+/**
+ Adds a free node to every free index the pool keeps.
+ The size of the node must not change while it is indexed.
+ */
+void indexFreeNode(mem_pool_t *pool, struct memoryList *node){
+    if (keepsSizeTree(pool)){
+        treeInsert(&pool->freeBySize, &node->bySize);
+    }
+    if (keepsSizeClasses(pool)){
+        tlsfInsert(pool, node);
+    }
+    if (keepsHeap(pool)){
+        heapPush(pool, node);
+    }
+    if (keepsFreeList(pool)){
+        if (isFreeListed(node)){
+            //Still in the list from before its size changed
+            treeRefresh(&pool->freeByAddress, &node->byFreeAddress);
+        } else {
+            freeListInsert(pool, node);
+        }
+    }
+    node->indexed = 1;
+    pool->holeCount++;
+    pool->freeBytes += node->size;
+    pool->freeHistogram[histogramBucket(node->size)]++;
+}
+
+/**
+ Removes a free node from every free index but the free list, which keeps
+ a node until it is allocated or removed; its place there doesn't depend on
+ its size. indexFreeNode() brings the sizes kept in freeByAddress up to date.
+ */
+void unindexFreeNode(mem_pool_t *pool, struct memoryList *node){
+    if (keepsSizeTree(pool)){
+        treeRemove(&pool->freeBySize, &node->bySize);
+    }
+    if (keepsHeap(pool)){
+        heapRemove(pool, node);
+    }
+    if (keepsSizeClasses(pool)){
+        tlsfRemove(pool, node);
+    }
+    node->indexed = 0;
+    pool->holeCount--;
+    pool->freeBytes -= node->size;
+    pool->freeHistogram[histogramBucket(node->size)]--;
+}
+
+/**
+ The free histogram bucket of a hole: the index of its highest set bit, or
+ 0 for an empty hole, which tlsfHighestBit() can't take
+ */
+int histogramBucket(size_t size){
+    return size == 0 ? 0 : tlsfHighestBit(size);
+}
+
+/**
+ 1 if the node is currently in the free indexes
+ */
+int isFreeIndexed(struct memoryList *node){
+    return node->indexed;
+}
+
+/**
+ 1 if the pool keeps the free nodes in freeByAddress and the free list
+ */
+int keepsFreeList(mem_pool_t *pool){
+    return pool->strategy == First || pool->strategy == Next;
+}
+
+/**
+ 1 if the pool keeps the free nodes in freeBySize: all but TLSF, whose
+ size classes answer mem_small_free() and mem_largest_free() instead
+ */
+int keepsSizeTree(mem_pool_t *pool){
+    return pool->strategy != Tlsf;
+}
+
+/**
+ 1 if the pool keeps the free nodes in freeHeap
+ */
+int keepsHeap(mem_pool_t *pool){
+    return pool->strategy == Worst;
+}
+
+/**
+ 1 if the pool keeps the free nodes in the TLSF size classes
+ */
+int keepsSizeClasses(mem_pool_t *pool){
+    return pool->strategy == Tlsf;
+}
+
+/**
+ 1 if the pool keeps every node in nodesByAddress. TLSF keeps startTable
+ instead, so that a split or merge costs it O(1) rather than O(log n).
+ */
+int keepsAddressTree(mem_pool_t *pool){
+    return pool->strategy != Tlsf;
+}
+
+/**
+ Links a free node into freeByAddress and into the free list, in front of
+ the first free node after it
+ */
+void freeListInsert(mem_pool_t *pool, struct memoryList *node){
+    struct memTreeLink *next = treeInsertNext(&pool->freeByAddress, &node->byFreeAddress);
+    struct memoryList *after = next ? nodeFromLink(next, byFreeAddress) : NULL;
+
+    node->freeNext = after;
+    node->freeLast = after ? after->freeLast : pool->freeTail;
+    if (node->freeLast){
+        node->freeLast->freeNext = node;
+    } else {
+        pool->freeHead = node;
+    }
+    if (after){
+        after->freeLast = node;
+    } else {
+        pool->freeTail = node;
+    }
+    roverConsider(pool, node);
+}
+
+/**
+ Unlinks a free node from freeByAddress and the free list
+ */
+void freeListRemove(mem_pool_t *pool, struct memoryList *node){
+    roverSkip(pool, node);
+    if (node->freeLast){
+        node->freeLast->freeNext = node->freeNext;
+    } else {
+        pool->freeHead = node->freeNext;
+    }
+    if (node->freeNext){
+        node->freeNext->freeLast = node->freeLast;
+    } else {
+        pool->freeTail = node->freeLast;
+    }
+    treeRemove(&pool->freeByAddress, &node->byFreeAddress);
+}
+
+/**
+ Puts replacement in the place of node in freeByAddress and the free list,
+ without a search. replacement must start inside the block of node, so no
+ other free node lies between them.
+ */
+void freeListReplace(mem_pool_t *pool, struct memoryList *node, struct memoryList *replacement){
+    roverSkip(pool, node);
+    replacement->freeLast = node->freeLast;
+    replacement->freeNext = node->freeNext;
+    if (node->freeLast){
+        node->freeLast->freeNext = replacement;
+    } else {
+        pool->freeHead = replacement;
+    }
+    if (node->freeNext){
+        node->freeNext->freeLast = replacement;
+    } else {
+        pool->freeTail = replacement;
+    }
+    treeReplace(&pool->freeByAddress, &node->byFreeAddress, &replacement->byFreeAddress);
+    roverConsider(pool, replacement);
+}
+
+/**
+ 1 if the node is currently in freeByAddress and the free list
+ */
+int isFreeListed(struct memoryList *node){
+    return node->byFreeAddress.height > 0;
+}
+
+/**
+ Next fit: a rover on a node that leaves the free list moves on to the
+ next free node, as the scan would have
+ */
+void roverSkip(mem_pool_t *pool, struct memoryList *node){
+    if (pool->rover == node){
+        pool->rover = node->freeNext ? node->freeNext : pool->freeHead;
+        if (pool->rover == node){
+            pool->rover = NULL; //It was the only free node
+        }
+    }
+}
+
+/**
+ Next fit: a node joining the free list becomes the rover when it lies
+ between lastVisited and the rover, since a scan would now reach it first
+ */
+void roverConsider(mem_pool_t *pool, struct memoryList *node){
+    struct memoryList *rover = pool->rover;
+    void *visited;
+
+    if (pool->strategy != Next){
+        return;
+    }
+    visited = pool->lastVisited->ptr;
+    if (rover == NULL
+        || (rover->ptr > visited && node->ptr > visited && node->ptr < rover->ptr)
+        || (rover->ptr <= visited && (node->ptr > visited || node->ptr < rover->ptr))){
+        pool->rover = node;
+    }
+}
+
+/**
+ The free node with the lowest address above ptr, or NULL
+ */
+struct memoryList *freeNodeAfter(mem_pool_t *pool, void *ptr){
+    struct memTreeLink *link = pool->freeByAddress.root;
+    struct memTreeLink *found = NULL;
+
+    while (link){
+        if (nodeFromLink(link, byFreeAddress)->ptr > ptr){
+            found = link; //After ptr, but there may be a lower one to the left
+            link = link->left;
+        } else {
+            link = link->right;
+        }
+    }
+    return found ? nodeFromLink(found, byFreeAddress) : NULL;
+}
+
+/**
+ Records the node the last allocation was made from. For Next this also
+ moves the rover to the free node after it, or the first one when there is none.
+ */
+void setLastVisited(mem_pool_t *pool, struct memoryList *node){
+    pool->lastVisited = node;
+    if (pool->strategy == Next){
+        //A free node is in the list already, so the one after it is at hand
+        struct memoryList *after = isFreeListed(node) ? node->freeNext : freeNodeAfter(pool, node->ptr);
+        pool->rover = after ? after : pool->freeHead;
+    }
+}
+
+/**
+ Keeps maxFreeBelow of a freeByAddress link: the largest of its own size and the maxFreeBelow of its children
+ */
+void updateMaxFreeBelow(struct memTreeLink *link){
+    struct memoryList *node = nodeFromLink(link, byFreeAddress);
+    size_t largest = node->size;
+
+    if (link->left && nodeFromLink(link->left, byFreeAddress)->maxFreeBelow > largest){
+        largest = nodeFromLink(link->left, byFreeAddress)->maxFreeBelow;
+    }
+    if (link->right && nodeFromLink(link->right, byFreeAddress)->maxFreeBelow > largest){
+        largest = nodeFromLink(link->right, byFreeAddress)->maxFreeBelow;
+    }
+    node->maxFreeBelow = largest;
+}
+
+/**
+ The free node with the lowest address in the freeByAddress subtree that can
+ hold requested bytes at an aligned address, or NULL. Subtrees with nothing
+ large enough are skipped, so without alignment it takes one path down.
+ */
+struct memoryList *lowestFreeFitting(struct memTreeLink *link, size_t alignment, size_t requested){
+    while (link && nodeFromLink(link, byFreeAddress)->maxFreeBelow >= requested){
+        struct memoryList *node = nodeFromLink(link, byFreeAddress);
+        struct memoryList *found = lowestFreeFitting(link->left, alignment, requested);
+
+        if (found){
+            return found;
+        }
+        if (node->size >= requested && node->size - requested >= alignPadding(node->ptr, alignment)){
+            return node;
+        }
+        link = link->right;
+    }
+    return NULL;
+}
+
+/**
+ Orders free nodes by size, then by address
+ */
+int compareBySize(struct memTreeLink *a, struct memTreeLink *b){
+    struct memoryList *nodeA = nodeFromLink(a, bySize);
+    struct memoryList *nodeB = nodeFromLink(b, bySize);
+    if (nodeA->size != nodeB->size){
+        return nodeA->size < nodeB->size ? -1 : 1;
+    }
+    if (nodeA->ptr != nodeB->ptr){
+        return nodeA->ptr < nodeB->ptr ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ Orders nodes by the address of their block
+ */
+int compareByAddress(struct memTreeLink *a, struct memTreeLink *b){
+    void *ptrA = nodeFromLink(a, byAddress)->ptr;
+    void *ptrB = nodeFromLink(b, byAddress)->ptr;
+    if (ptrA != ptrB){
+        return ptrA < ptrB ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ Orders free nodes by the address of their block
+ */
+int compareByFreeAddress(struct memTreeLink *a, struct memTreeLink *b){
+    void *ptrA = nodeFromLink(a, byFreeAddress)->ptr;
+    void *ptrB = nodeFromLink(b, byFreeAddress)->ptr;
+    if (ptrA != ptrB){
+        return ptrA < ptrB ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ The free node with the smallest size >= requested (lowest address on ties), or NULL
+ */
+struct memoryList *smallestFreeFitting(mem_pool_t *pool, size_t requested){
+    struct memTreeLink *link = pool->freeBySize.root;
+    struct memTreeLink *found = NULL;
+
+    while (link){
+        if (nodeFromLink(link, bySize)->size >= requested){
+            found = link; //Fits, but there may be a smaller one to the left
+            link = link->left;
+        } else {
+            link = link->right;
+        }
+    }
+    return found ? nodeFromLink(found, bySize) : NULL;
+}
+
+/**
+ Smallest free node in the subtree that can hold requested bytes at an
+ aligned address; the lowest address wins a tie. Visits the nodes in
+ order from the smallest one that is large enough, so it stops at the
+ first node with alignment - 1 bytes to spare at the latest.
+ */
+struct memoryList *smallestFreeFittingAligned(struct memTreeLink *link, size_t alignment, size_t requested){
+    while (link){
+        struct memoryList *node = nodeFromLink(link, bySize);
+        struct memoryList *found;
+
+        if (node->size < requested){
+            link = link->right; //Everything to the left is smaller still
+            continue;
+        }
+        found = smallestFreeFittingAligned(link->left, alignment, requested);
+        if (found != NULL){
+            return found;
+        }
+        if (node->size - requested >= alignPadding(node->ptr, alignment)){
+            return node;
+        }
+        link = link->right;
+    }
+    return NULL;
+}
+
+/**
+ Largest free node in the subtree that can hold requested bytes at an
+ aligned address. Visits the nodes from the largest one down.
+ */
+struct memoryList *largestFreeFittingAligned(struct memTreeLink *link, size_t alignment, size_t requested){
+    while (link){
+        struct memoryList *node = nodeFromLink(link, bySize);
+        struct memoryList *found = largestFreeFittingAligned(link->right, alignment, requested);
+
+        if (found != NULL){
+            return found;
+        }
+        if (node->size < requested){
+            return NULL; //So is everything to the left
+        }
+        if (node->size - requested >= alignPadding(node->ptr, alignment)){
+            return node;
+        }
+        link = link->left;
+    }
+    return NULL;
+}
+
+//-------------------Free node heap----------------------------------------
+/**
+ 1 if a belongs above b in the heap
+ */
+int heapAbove(struct memoryList *a, struct memoryList *b){
+    return a->size > b->size || (a->size == b->size && a->ptr < b->ptr);
+}
+
+void heapPlace(mem_pool_t *pool, struct memoryList *node, size_t index){
+    pool->freeHeap[index] = node;
+    node->heapIndex = index;
+}
+
+void heapSiftUp(mem_pool_t *pool, size_t index){
+    struct memoryList *node = pool->freeHeap[index];
+    while (index > 0){
+        size_t parent = (index - 1) / 2;
+        if (!heapAbove(node, pool->freeHeap[parent])){
+            break;
+        }
+        heapPlace(pool, pool->freeHeap[parent], index);
+        index = parent;
+    }
+    heapPlace(pool, node, index);
+}
+
+void heapSiftDown(mem_pool_t *pool, size_t index){
+    struct memoryList *node = pool->freeHeap[index];
+    while (1){
+        size_t child = 2 * index + 1;
+        if (child >= pool->freeHeapCount){
+            break;
+        }
+        if (child + 1 < pool->freeHeapCount && heapAbove(pool->freeHeap[child + 1], pool->freeHeap[child])){
+            child++;
+        }
+        if (!heapAbove(pool->freeHeap[child], node)){
+            break;
+        }
+        heapPlace(pool, pool->freeHeap[child], index);
+        index = child;
+    }
+    heapPlace(pool, node, index);
+}
+
+void heapPush(mem_pool_t *pool, struct memoryList *node){
+    if (pool->freeHeapCount == pool->freeHeapCapacity){
+        pool->freeHeapCapacity = pool->freeHeapCapacity ? 2 * pool->freeHeapCapacity : 64;
+        pool->freeHeap = (struct memoryList **)realloc(pool->freeHeap, pool->freeHeapCapacity * sizeof(struct memoryList *));
+        if (pool->freeHeap == NULL){
+            printf("MALLOC ERROR!\n");
+            exit(1);
+        }
+    }
+    heapPlace(pool, node, pool->freeHeapCount++);
+    heapSiftUp(pool, node->heapIndex);
+}
+
+/**
+ Removes the node from wherever it is in the heap, using its heapIndex
+ */
+void heapRemove(mem_pool_t *pool, struct memoryList *node){
+    size_t index = node->heapIndex;
+    struct memoryList *moved = pool->freeHeap[--pool->freeHeapCount];
+
+    if (moved == node){
+        return; //Was the last element
+    }
+    //Fill the gap with the last element and move it whichever way it needs to go
+    heapPlace(pool, moved, index);
+    heapSiftUp(pool, index);
+    heapSiftDown(pool, moved->heapIndex);
+}
+
+//-------------------TLSF size classes-------------------------------------
+/**
+ Index of the highest set bit. size must not be 0.
+ */
+int tlsfHighestBit(uint64_t size){
+    return 63 - __builtin_clzll(size);
+}
+
+/**
+ The size class that a block of the given size is stored in
+ */
+void tlsfMapping(size_t size, int *firstLevel, int *secondLevel){
+    if (size < TLSF_SL_COUNT){
+        *firstLevel = 0;
+        *secondLevel = (int)size;
+    } else {
+        int highestBit = tlsfHighestBit(size);
+        *firstLevel = highestBit - TLSF_SL_LOG2 + 1;
+        *secondLevel = (int)(size >> (highestBit - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+    }
+}
+
+void tlsfInit(mem_pool_t *pool){
+    pool->tlsfFirstLevel = 0;
+    memset(pool->tlsfSecondLevel, 0, sizeof(pool->tlsfSecondLevel));
+    memset(pool->tlsfBins, 0, sizeof(pool->tlsfBins));
+    memset(pool->tlsfBinTails, 0, sizeof(pool->tlsfBinTails));
+    memset(pool->tlsfBinCounts, 0, sizeof(pool->tlsfBinCounts));
+}
+
+/**
+ Appends the node to its class, so each class hands out its oldest node first
+ */
+void tlsfInsert(mem_pool_t *pool, struct memoryList *node){
+    int firstLevel, secondLevel;
+    tlsfMapping(node->size, &firstLevel, &secondLevel);
+
+    node->binNext = NULL;
+    node->binLast = pool->tlsfBinTails[firstLevel][secondLevel];
+    if (node->binLast){
+        node->binLast->binNext = node;
+    } else {
+        pool->tlsfBins[firstLevel][secondLevel] = node;
+    }
+    pool->tlsfBinTails[firstLevel][secondLevel] = node;
+    pool->tlsfBinCounts[firstLevel][secondLevel]++;
+
+    pool->tlsfFirstLevel |= (uint64_t)1 << firstLevel;
+    pool->tlsfSecondLevel[firstLevel] |= (uint32_t)1 << secondLevel;
+}
+
+void tlsfRemove(mem_pool_t *pool, struct memoryList *node){
+    int firstLevel, secondLevel;
+    tlsfMapping(node->size, &firstLevel, &secondLevel);
+
+    if (node->binLast){
+        node->binLast->binNext = node->binNext;
+    } else {
+        pool->tlsfBins[firstLevel][secondLevel] = node->binNext;
+    }
+    if (node->binNext){
+        node->binNext->binLast = node->binLast;
+    } else {
+        pool->tlsfBinTails[firstLevel][secondLevel] = node->binLast;
+    }
+    pool->tlsfBinCounts[firstLevel][secondLevel]--;
+
+    //Clear the bits of a class that became empty
+    if (pool->tlsfBins[firstLevel][secondLevel] == NULL){
+        pool->tlsfSecondLevel[firstLevel] &= ~((uint32_t)1 << secondLevel);
+        if (pool->tlsfSecondLevel[firstLevel] == 0){
+            pool->tlsfFirstLevel &= ~((uint64_t)1 << firstLevel);
+        }
+    }
+}
+
+/**
+ The oldest node of the smallest non-empty class whose nodes all fit requested, or NULL.
+ Constant time: two bitmap lookups, no list walk.
+ */
+struct memoryList *tlsfFindFitting(mem_pool_t *pool, size_t requested){
+    int firstLevel, secondLevel;
+    uint32_t secondLevelMap;
+
+    //Round up to the next class boundary, so that every node in the class fits
+    if (requested >= TLSF_SL_COUNT){
+        size_t roundUp = ((size_t)1 << (tlsfHighestBit(requested) - TLSF_SL_LOG2)) - 1;
+        if (requested + roundUp < requested){
+            return NULL; //Overflow; nothing this large exists
+        }
+        requested += roundUp;
+    }
+    tlsfMapping(requested, &firstLevel, &secondLevel);
+
+    secondLevelMap = secondLevel < 32 ? pool->tlsfSecondLevel[firstLevel] & (~(uint32_t)0 << secondLevel) : 0;
+    if (secondLevelMap == 0){
+        //Nothing in this first level; take the next non-empty one
+        uint64_t firstLevelMap = firstLevel + 1 < 64 ? pool->tlsfFirstLevel & (~(uint64_t)0 << (firstLevel + 1)) : 0;
+        if (firstLevelMap == 0){
+            return NULL;
+        }
+        firstLevel = __builtin_ctzll(firstLevelMap);
+        secondLevelMap = pool->tlsfSecondLevel[firstLevel];
+    }
+    secondLevel = __builtin_ctz(secondLevelMap);
+    return pool->tlsfBins[firstLevel][secondLevel];
+}
+
+/**
+ The smallest and largest size stored in a class
+ */
+void tlsfClassRange(int firstLevel, int secondLevel, size_t *smallest, size_t *largest){
+    if (firstLevel == 0){
+        *smallest = *largest = (size_t)secondLevel;
+    } else {
+        *smallest = (size_t)(TLSF_SL_COUNT + secondLevel) << (firstLevel - 1);
+        *largest = *smallest + ((size_t)1 << (firstLevel - 1)) - 1;
+    }
+}
+
+/**
+ Size of the largest free node: the largest one in the highest non-empty class
+ */
+int tlsfLargestFree(mem_pool_t *pool){
+    struct memoryList *node;
+    size_t largest = 0;
+    int firstLevel, secondLevel;
+
+    if (pool->tlsfFirstLevel == 0){
+        return 0;
+    }
+    firstLevel = tlsfHighestBit(pool->tlsfFirstLevel);
+    secondLevel = tlsfHighestBit(pool->tlsfSecondLevel[firstLevel]);
+    for (node = pool->tlsfBins[firstLevel][secondLevel]; node != NULL; node = node->binNext){
+        largest = node->size > largest ? node->size : largest;
+    }
+    return (int)largest;
+}
+
+/**
+ Number of free nodes of at most size bytes. Classes wholly below size
+ count as a whole; only the one class that straddles size is walked.
+ */
+int tlsfSmallFree(mem_pool_t *pool, int size){
+    uint64_t firstLevelMap = pool->tlsfFirstLevel;
+    int count = 0;
+
+    while (size >= 0 && firstLevelMap != 0){
+        int firstLevel = __builtin_ctzll(firstLevelMap);
+        uint32_t secondLevelMap = pool->tlsfSecondLevel[firstLevel];
+
+        while (secondLevelMap != 0){
+            int secondLevel = __builtin_ctz(secondLevelMap);
+            size_t smallest, largest;
+            struct memoryList *node;
+
+            tlsfClassRange(firstLevel, secondLevel, &smallest, &largest);
+            if (smallest > (size_t)size){
+                return count; //So is every class after it
+            }
+            if (largest <= (size_t)size){
+                count += (int)pool->tlsfBinCounts[firstLevel][secondLevel];
+            } else {
+                for (node = pool->tlsfBins[firstLevel][secondLevel]; node != NULL; node = node->binNext){
+                    count += node->size <= (size_t)size;
+                }
+            }
+            secondLevelMap &= secondLevelMap - 1;
+        }
+        firstLevelMap &= firstLevelMap - 1;
+    }
+    return count;
+}
+
+//-------------------AVL tree----------------------------------------------
+int treeHeight(struct memTreeLink *link){
+    return link ? link->height : 0;
+}
+
+size_t treeCount(struct memTreeLink *link){
+    return link ? link->count : 0;
+}
+
+/**
+ Recomputes the height and count of link, and whatever update() keeps, from its children
+ */
+void treeUpdate(struct memTree *tree, struct memTreeLink *link){
+    int leftHeight = treeHeight(link->left);
+    int rightHeight = treeHeight(link->right);
+    link->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    link->count = 1 + treeCount(link->left) + treeCount(link->right);
+    if (tree->update){
+        tree->update(link);
+    }
+}
+
+struct memTreeLink *treeRotateRight(struct memTree *tree, struct memTreeLink *link){
+    struct memTreeLink *newRoot = link->left;
+    link->left = newRoot->right;
+    newRoot->right = link;
+    treeUpdate(tree, link);
+    treeUpdate(tree, newRoot);
+    return newRoot;
+}
+
+struct memTreeLink *treeRotateLeft(struct memTree *tree, struct memTreeLink *link){
+    struct memTreeLink *newRoot = link->right;
+    link->right = newRoot->left;
+    newRoot->left = link;
+    treeUpdate(tree, link);
+    treeUpdate(tree, newRoot);
+    return newRoot;
+}
+
+/**
+ Restores the AVL property at link. Returns the new root of the subtree.
+ */
+struct memTreeLink *treeBalance(struct memTree *tree, struct memTreeLink *link){
+    int balance;
+
+    treeUpdate(tree, link);
+    balance = treeHeight(link->left) - treeHeight(link->right);
+    if (balance > 1){
+        if (treeHeight(link->left->left) < treeHeight(link->left->right)){
+            link->left = treeRotateLeft(tree, link->left);
+        }
+        return treeRotateRight(tree, link);
+    }
+    if (balance < -1){
+        if (treeHeight(link->right->right) < treeHeight(link->right->left)){
+            link->right = treeRotateRight(tree, link->right);
+        }
+        return treeRotateLeft(tree, link);
+    }
+    return link;
+}
+
+/**
+ Inserts link into the subtree. *after is set to the lowest link above it
+ on the way down, unless the whole subtree is below it.
+ Returns the new root of the subtree.
+ */
+struct memTreeLink *treeInsertAt(struct memTree *tree, struct memTreeLink *root, struct memTreeLink *link, struct memTreeLink **after){
+    if (root == NULL){
+        link->left = NULL;
+        link->right = NULL;
+        treeUpdate(tree, link);
+        return link;
+    }
+    if (tree->compare(link, root) < 0){
+        *after = root;
+        root->left = treeInsertAt(tree, root->left, link, after);
+    } else {
+        root->right = treeInsertAt(tree, root->right, link, after);
+    }
+    return treeBalance(tree, root);
+}
+
+/**
+ Unlinks the leftmost link of the subtree into *min. Returns the new root of the subtree.
+ */
+struct memTreeLink *treeRemoveMin(struct memTree *tree, struct memTreeLink *root, struct memTreeLink **min){
+    if (root->left == NULL){
+        *min = root;
+        return root->right;
+    }
+    root->left = treeRemoveMin(tree, root->left, min);
+    return treeBalance(tree, root);
+}
+
+struct memTreeLink *treeRemoveAt(struct memTree *tree, struct memTreeLink *root, struct memTreeLink *link){
+    int cmp;
+
+    if (root == NULL){
+        return NULL; //Not in the tree
+    }
+    cmp = tree->compare(link, root);
+    if (cmp < 0){
+        root->left = treeRemoveAt(tree, root->left, link);
+    } else if (cmp > 0){
+        root->right = treeRemoveAt(tree, root->right, link);
+    } else {
+        //root is link: replace it with its in-order successor
+        struct memTreeLink *left = root->left;
+        struct memTreeLink *right = root->right;
+        struct memTreeLink *successor;
+
+        root->height = 0;
+        if (right == NULL){
+            return left;
+        }
+        right = treeRemoveMin(tree, right, &successor);
+        successor->left = left;
+        successor->right = right;
+        return treeBalance(tree, successor);
+    }
+    return treeBalance(tree, root);
+}
+
+void treeInsert(struct memTree *tree, struct memTreeLink *link){
+    treeInsertNext(tree, link);
+}
+
+/**
+ Inserts link and returns the link after it in order, or NULL if it is the last one
+ */
+struct memTreeLink *treeInsertNext(struct memTree *tree, struct memTreeLink *link){
+    struct memTreeLink *after = NULL;
+
+    tree->root = treeInsertAt(tree, tree->root, link, &after);
+    return after;
+}
+
+void treeRemove(struct memTree *tree, struct memTreeLink *link){
+    tree->root = treeRemoveAt(tree, tree->root, link);
+}
+
+/**
+ Puts replacement where link is, keeping its children. replacement must
+ compare the same against every other link, so the tree stays ordered.
+ */
+void treeReplace(struct memTree *tree, struct memTreeLink *link, struct memTreeLink *replacement){
+    struct memTreeLink **slot = &tree->root;
+
+    while (*slot != link){
+        slot = tree->compare(link, *slot) < 0 ? &(*slot)->left : &(*slot)->right;
+    }
+    *replacement = *link;
+    *slot = replacement;
+    link->height = 0;
+}
+
+/**
+ Recomputes link and every link above it, after a change to link that
+ update() depends on but compare() doesn't
+ */
+void treeRefresh(struct memTree *tree, struct memTreeLink *link){
+    struct memTreeLink *path[2 * sizeof(size_t) * 8]; // An AVL tree of n links is less than 1.45 log2(n) high
+    struct memTreeLink *at = tree->root;
+    int depth = 0;
+
+    while (at != link){
+        path[depth++] = at;
+        at = tree->compare(link, at) < 0 ? at->left : at->right;
+    }
+    treeUpdate(tree, link);
+    while (depth > 0){
+        treeUpdate(tree, path[--depth]);
+    }
+}
+
+//-------------------Boundary tag mode-------------------------------------
+struct tagPoolHeader *tagPool(mem_pool_t *pool){
+    return (struct tagPoolHeader *)pool->memory;
+}
+
+size_t *tagWord(mem_pool_t *pool, size_t offset){
+    return (size_t *)((char *)pool->memory + offset);
+}
+
+size_t tagSize(mem_pool_t *pool, size_t block){
+    return *tagWord(pool, block) & ~TAG_ALLOC;
+}
+
+int tagIsAlloc(mem_pool_t *pool, size_t block){
+    return (*tagWord(pool, block) & TAG_ALLOC) != 0;
+}
+
+size_t *tagNextFree(mem_pool_t *pool, size_t block){
+    return tagWord(pool, block + TAG_SIZE);
+}
+
+size_t *tagPrevFree(mem_pool_t *pool, size_t block){
+    return tagWord(pool, block + 2 * TAG_SIZE);
+}
+
+/**
+ Writes the footer, then the header, of a block.
+ Writing the header last means a walk over the headers never sees a half-written block.
+ */
+void tagWrite(mem_pool_t *pool, size_t block, size_t size, int alloc){
+    size_t tag = size | (alloc ? TAG_ALLOC : 0);
+    *tagWord(pool, block + size - TAG_SIZE) = tag;
+    //Keeps the compiler from storing the header first; a process dying in between leaves the order in the file
+    atomic_signal_fence(memory_order_release);
+    *tagWord(pool, block) = tag;
+}
+
+/**
+ Lays out the pool as the header and one free block
+ */
+void tagInit(mem_pool_t *pool){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t start;
+
+    if (pool->memory == NULL || pool->size < sizeof(struct tagPoolHeader)){
+        return;
+    }
+    //Payloads (block + TAG_SIZE) must be 16-byte aligned
+    start = (sizeof(struct tagPoolHeader) + TAG_SIZE + TAG_ALIGN - 1) / TAG_ALIGN * TAG_ALIGN - TAG_SIZE;
+    header->freeList = TAG_NONE;
+    header->rover = TAG_NONE;
+    header->start = start;
+    header->end = start;
+    header->holes = 0;
+    header->allocated = 0;
+    header->free = 0;
+    if (pool->size >= start + TAG_MIN_BLOCK){
+        size_t size = (pool->size - start) / TAG_ALIGN * TAG_ALIGN;
+        header->end = start + size;
+        tagWrite(pool, start, size, 0);
+        tagPushFree(pool, start);
+    }
+}
+
+void tagPushFree(mem_pool_t *pool, size_t block){
+    struct tagPoolHeader *header = tagPool(pool);
+
+    *tagNextFree(pool, block) = header->freeList;
+    *tagPrevFree(pool, block) = TAG_NONE;
+    if (header->freeList != TAG_NONE){
+        *tagPrevFree(pool, header->freeList) = block;
+    }
+    header->freeList = block;
+    header->holes++;
+    header->free += tagSize(pool, block) - TAG_OVERHEAD;
+}
+
+void tagUnlinkFree(mem_pool_t *pool, size_t block){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t next = *tagNextFree(pool, block);
+    size_t prev = *tagPrevFree(pool, block);
+
+    if (prev != TAG_NONE){
+        *tagNextFree(pool, prev) = next;
+    } else {
+        header->freeList = next;
+    }
+    if (next != TAG_NONE){
+        *tagPrevFree(pool, next) = prev;
+    }
+    //Keep the next fit rover on a free block
+    if (header->rover == block){
+        header->rover = next;
+    }
+    header->holes--;
+    header->free -= tagSize(pool, block) - TAG_OVERHEAD;
+}
+
+/**
+ Picks a free block of at least size bytes according to the pool strategy, or TAG_NONE.
+ Tlsf, Buddy and Bitmap have no in-band index and use best fit here.
+ */
+size_t tagFindFree(mem_pool_t *pool, size_t size){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t found = TAG_NONE;
+    size_t block;
+
+    if (pool->strategy == Next){
+        size_t start = header->rover != TAG_NONE ? header->rover : header->freeList;
+        if (start == TAG_NONE){
+            return TAG_NONE;
+        }
+        block = start;
+        do {
+            if (tagSize(pool, block) >= size){
+                return block;
+            }
+            block = *tagNextFree(pool, block);
+            if (block == TAG_NONE){
+                block = header->freeList; //Wrap around
+            }
+        } while (block != start);
+        return TAG_NONE;
+    }
+
+    for (block = header->freeList; block != TAG_NONE; block = *tagNextFree(pool, block)){
+        size_t blockSize = tagSize(pool, block);
+        if (blockSize < size){
+            continue;
+        }
+        if (pool->strategy == First){
+            return block;
+        }
+        if (found == TAG_NONE
+            || (pool->strategy == Worst && blockSize > tagSize(pool, found))
+            || (pool->strategy != Worst && blockSize < tagSize(pool, found))){
+            found = block;
+            if (pool->strategy != Worst && blockSize == size){
+                break; //Can't fit better than exactly
+            }
+        }
+    }
+    return found;
+}
+
+void *tagMalloc(mem_pool_t *pool, size_t requested){
+    size_t size;
+    size_t block;
+    size_t blockSize;
+
+    if (requested > pool->size){
+        return NULL;
+    }
+    size = (requested + TAG_OVERHEAD + TAG_ALIGN - 1) / TAG_ALIGN * TAG_ALIGN;
+    if (size < TAG_MIN_BLOCK){
+        size = TAG_MIN_BLOCK;
+    }
+    block = tagFindFree(pool, size);
+    if (block == TAG_NONE){
+        return NULL;
+    }
+    blockSize = tagSize(pool, block);
+    tagUnlinkFree(pool, block);
+    return tagAllocAt(pool, block, blockSize, size);
+}
+
+/**
+ Like tagMalloc() for alignments above TAG_ALIGN. A free block with room
+ for the alignment and a whole free block in front is picked; the part
+ before the aligned payload is given back as a free block.
+ */
+void *tagMallocAligned(mem_pool_t *pool, size_t alignment, size_t requested){
+    size_t size;
+    size_t block;
+    size_t blockSize;
+    size_t lead;
+
+    if (requested > pool->size || alignment > pool->size){
+        return NULL;
+    }
+    size = (requested + TAG_OVERHEAD + TAG_ALIGN - 1) / TAG_ALIGN * TAG_ALIGN;
+    if (size < TAG_MIN_BLOCK){
+        size = TAG_MIN_BLOCK;
+    }
+    block = tagFindFree(pool, size + alignment + TAG_MIN_BLOCK);
+    if (block == TAG_NONE){
+        return NULL;
+    }
+    blockSize = tagSize(pool, block);
+    tagUnlinkFree(pool, block);
+
+    //Payloads are 16-byte aligned, so lead is a multiple of 16; it must be 0 or hold a free block
+    lead = alignPadding((char *)pool->memory + block + TAG_SIZE, alignment);
+    if (lead > 0 && lead < TAG_MIN_BLOCK){
+        lead += alignment;
+    }
+    if (lead > 0){
+        tagWrite(pool, block + lead, blockSize - lead, 0);
+        tagWrite(pool, block, lead, 0);
+        tagPushFree(pool, block);
+        block += lead;
+        blockSize -= lead;
+    }
+    return tagAllocAt(pool, block, blockSize, size);
+}
+
+/**
+ Allocates size bytes at the start of a block that is no longer on the free
+ list, and gives any large enough rest back as a free block
+ */
+void *tagAllocAt(mem_pool_t *pool, size_t block, size_t blockSize, size_t size){
+    struct tagPoolHeader *header = tagPool(pool);
+
+    if (blockSize - size >= TAG_MIN_BLOCK){
+        //Split: the remainder is written before the block shrinks
+        size_t remainder = block + size;
+        tagWrite(pool, remainder, blockSize - size, 0);
+        tagPushFree(pool, remainder);
+        header->rover = remainder;
+        tagWrite(pool, block, size, 1);
+    } else {
+        size = blockSize;
+        tagWrite(pool, block, size, 1);
+        if (header->rover == TAG_NONE){
+            header->rover = header->freeList;
+        }
+    }
+    header->allocated += size - TAG_OVERHEAD;
+    return (char *)pool->memory + block + TAG_SIZE;
+}
+
+/**
+ Frees the block whose payload starts at ptr, coalescing with its physical
+ neighbors by reading their tags. No list is walked.
+ */
+void tagFree(mem_pool_t *pool, void *ptr){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t block;
+    size_t size;
+
+    if ((char *)ptr < (char *)pool->memory + header->start + TAG_SIZE || (char *)ptr >= (char *)pool->memory + header->end){
+        if (debugMessages){
+            printf("Myfree didn't find the node it was looking for\n");
+        }
+        return;
+    }
+    block = (size_t)((char *)ptr - (char *)pool->memory) - TAG_SIZE;
+    size = tagSize(pool, block);
+    if (!tagIsAlloc(pool, block) || size < TAG_MIN_BLOCK || block + size > header->end || *tagWord(pool, block + size - TAG_SIZE) != *tagWord(pool, block)){
+        if (debugMessages){
+            printf("Myfree didn't find the node it was looking for\n");
+        }
+        return;
+    }
+    header->allocated -= size - TAG_OVERHEAD;
+
+    //Merge with the right neighbor, found right after this block
+    if (block + size < header->end && !tagIsAlloc(pool, block + size)){
+        size_t right = block + size;
+        tagUnlinkFree(pool, right);
+        size += tagSize(pool, right);
+    }
+    //Merge with the left neighbor, found from its footer right before this block
+    if (block > header->start && !(*tagWord(pool, block - TAG_SIZE) & TAG_ALLOC)){
+        size_t left = block - (*tagWord(pool, block - TAG_SIZE) & ~TAG_ALLOC);
+        tagUnlinkFree(pool, left);
+        size += block - left;
+        block = left;
+    }
+    tagWrite(pool, block, size, 0);
+    tagPushFree(pool, block);
+    //The header and free list links at the front and the footer stay
+    releaseHole(pool, (char *)pool->memory + block, size, TAG_SIZE + 2 * sizeof(size_t), TAG_SIZE);
+}
+
+int tagLargestFree(mem_pool_t *pool){
+    size_t largest = 0;
+    size_t block;
+    for (block = tagPool(pool)->freeList; block != TAG_NONE; block = *tagNextFree(pool, block)){
+        if (tagSize(pool, block) - TAG_OVERHEAD > largest){
+            largest = tagSize(pool, block) - TAG_OVERHEAD;
+        }
+    }
+    return largest;
+}
+
+int tagSmallFree(mem_pool_t *pool, int size){
+    int numOfSmallFree = 0;
+    size_t block;
+    for (block = tagPool(pool)->freeList; block != TAG_NONE; block = *tagNextFree(pool, block)){
+        if (size >= 0 && tagSize(pool, block) - TAG_OVERHEAD <= (size_t)size){
+            numOfSmallFree++;
+        }
+    }
+    return numOfSmallFree;
+}
+
+int tagFreeHistogram(mem_pool_t *pool, int *counts, int buckets){
+    int used = 0;
+    int k;
+    size_t block;
+
+    for (k = 0; k < buckets; k++){
+        counts[k] = 0;
+    }
+    for (block = tagPool(pool)->freeList; block != TAG_NONE; block = *tagNextFree(pool, block)){
+        k = histogramBucket(tagSize(pool, block) - TAG_OVERHEAD);
+        if (k + 1 > used){
+            used = k + 1;
+        }
+        if (buckets > 0){
+            counts[k < buckets ? k : buckets - 1]++;
+        }
+    }
+    return used;
+}
+
+/**
+ Walks the headers from the first block to the one holding ptr.
+ The tags of a block count as part of it.
+ */
+char tagIsAllocAt(mem_pool_t *pool, void *ptr){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t offset = (size_t)((char *)ptr - (char *)pool->memory);
+    size_t block = header->start;
+
+    while (block < header->end){
+        size_t size = tagSize(pool, block);
+        if (offset < block + size){
+            return offset >= block && tagIsAlloc(pool, block);
+        }
+        block += size;
+    }
+    return 0;
+}
+
+void tagPrintMemory(mem_pool_t *pool){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t block;
+    for (block = header->start; block < header->end; block += tagSize(pool, block)){
+        printf("Block{\nOffset: %zu\nSize: %zu\nAlloc: %d\nPtr: %p\n}\n",block,tagSize(pool, block),tagIsAlloc(pool, block),(char *)pool->memory + block + TAG_SIZE);
+    }
+}
+
+//-------------------Thread caches-----------------------------------------
+/**
+ The calling thread's cache for the pool, created on first use.
+ Returns NULL if it can't be allocated; the caller then uses the pool directly.
+ */
+struct threadCache *threadCacheOf(mem_pool_t *pool){
+    struct threadCache *cache = (struct threadCache *)pthread_getspecific(pool->cacheKey);
+
+    if (cache != NULL){
+        return cache;
+    }
+    cache = (struct threadCache *)calloc(1, sizeof(struct threadCache));
+    if (cache == NULL){
+        return NULL;
+    }
+    cache->pool = pool;
+    pthread_mutex_lock(&pool->lock);
+    cache->next = pool->caches;
+    if (pool->caches != NULL){
+        pool->caches->last = cache;
+    }
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->lock);
+    pthread_setspecific(pool->cacheKey, cache);
+    return cache;
+}
+
+/**
+ Gives up to count blocks of a bin back to the pool. The caller holds pool->lock.
+ */
+void cacheDrain(struct threadCache *cache, int sizeClass, int count){
+    while (count-- > 0 && cache->bins[sizeClass] != NULL){
+        void *block = cache->bins[sizeClass];
+        cache->bins[sizeClass] = *(void **)block;
+        cache->binCounts[sizeClass]--;
+        centralFree(cache->pool, (char *)block - CACHE_HEADER);
+    }
+}
+
+/**
+ Takes up to CACHE_REFILL blocks of the class from the pool into the bin.
+ If the pool has no room, every bin of this cache is given back first and
+ the pool is tried once more. The caller holds pool->lock.
+ */
+void cacheRefill(struct threadCache *cache, int sizeClass){
+    size_t blockSize = (size_t)(sizeClass + 1) * 16 + CACHE_HEADER;
+    int i;
+
+    for (i = 0; i < CACHE_REFILL; i++){
+        char *block = (char *)centralMalloc(cache->pool, CACHE_HEADER, blockSize);
+        if (block == NULL){
+            break;
+        }
+        *(size_t *)block = sizeClass;
+        *(void **)(block + CACHE_HEADER) = cache->bins[sizeClass];
+        cache->bins[sizeClass] = block + CACHE_HEADER;
+        cache->binCounts[sizeClass]++;
+    }
+    if (i == 0){
+        int other;
+        for (other = 0; other < CACHE_CLASSES; other++){
+            cacheDrain(cache, other, cache->binCounts[other]);
+        }
+        char *block = (char *)centralMalloc(cache->pool, CACHE_HEADER, blockSize);
+        if (block != NULL){
+            *(size_t *)block = sizeClass;
+            *(void **)(block + CACHE_HEADER) = NULL;
+            cache->bins[sizeClass] = block + CACHE_HEADER;
+            cache->binCounts[sizeClass] = 1;
+        }
+    }
+}
+
+/**
+ mem_pool_malloc() with MEM_THREAD_CACHE. Small requests are served from
+ the calling thread's bin without locking while it has blocks.
+ */
+void *cacheMalloc(mem_pool_t *pool, size_t requested){
+    struct threadCache *cache = NULL;
+    int sizeClass = requested > 0 ? (int)((requested - 1) / 16) : 0;
+    char *block;
+
+    if (requested > CACHE_MAX_SIZE || (cache = threadCacheOf(pool)) == NULL){
+        pthread_mutex_lock(&pool->lock);
+        //Whole multiples of the header, so the free space after the block stays aligned too
+        block = (char *)centralMalloc(pool, CACHE_HEADER, (requested + 2 * CACHE_HEADER - 1) / CACHE_HEADER * CACHE_HEADER);
+        pthread_mutex_unlock(&pool->lock);
+        if (block == NULL){
+            return NULL;
+        }
+        ((size_t *)block)[0] = CACHE_CLASSES;
+        ((size_t *)block)[1] = CACHE_HEADER;
+        return block + CACHE_HEADER;
+    }
+    if (cache->bins[sizeClass] == NULL){
+        pthread_mutex_lock(&pool->lock);
+        cacheRefill(cache, sizeClass);
+        pthread_mutex_unlock(&pool->lock);
+        if (cache->bins[sizeClass] == NULL){
+            return NULL;
+        }
+    }
+    block = (char *)cache->bins[sizeClass];
+    cache->bins[sizeClass] = *(void **)block;
+    cache->binCounts[sizeClass]--;
+    return block;
+}
+
+/**
+ mem_pool_malloc_aligned() with MEM_THREAD_CACHE. Aligned blocks bypass the
+ cache. The pool aligns the start of a block that has room for the header
+ in the first alignment bytes; the caller gets the aligned address after them.
+ */
+void *cacheMallocAligned(mem_pool_t *pool, size_t alignment, size_t requested){
+    char *block;
+
+    if (alignment < CACHE_HEADER){
+        alignment = CACHE_HEADER;
+    }
+    pthread_mutex_lock(&pool->lock);
+    block = (char *)centralMalloc(pool, alignment, requested + alignment);
+    pthread_mutex_unlock(&pool->lock);
+    if (block == NULL){
+        return NULL;
+    }
+    block += alignment;
+    ((size_t *)block)[-2] = CACHE_CLASSES;
+    ((size_t *)block)[-1] = alignment;
+    return block;
+}
+
+/**
+ The start of the pool block behind a block handed out with MEM_THREAD_CACHE
+ */
+void *cacheBlockStart(void *block){
+    size_t *header = (size_t *)((char *)block - CACHE_HEADER);
+    return (char *)block - (header[0] == CACHE_CLASSES ? header[1] : CACHE_HEADER);
+}
+
+/**
+ 1 if block was allocated by mem_pool_malloc_handle(). Such a block has no
+ cache header in front of it, even in a MEM_THREAD_CACHE pool, so this is
+ asked before reading one.
+ */
+int isHandleBlock(mem_pool_t *pool, void *block){
+    struct memoryList *node;
+    int handle;
+
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        return 0; //No handles
+    }
+    pthread_mutex_lock(&pool->lock);
+    node = allocTableFind(pool, block);
+    handle = node != NULL && node->handle != 0;
+    pthread_mutex_unlock(&pool->lock);
+    return handle;
+}
+
+/**
+ mem_pool_free() with MEM_THREAD_CACHE. Small blocks go to the calling
+ thread's bin without locking until it overflows. A block may be freed by
+ any thread, not just the one that allocated it.
+ */
+void cacheFree(mem_pool_t *pool, void *block){
+    struct threadCache *cache = NULL;
+    size_t sizeClass;
+
+    if (block == NULL){
+        return;
+    }
+    sizeClass = *(size_t *)((char *)block - CACHE_HEADER);
+    if (sizeClass >= CACHE_CLASSES || (cache = threadCacheOf(pool)) == NULL){
+        pthread_mutex_lock(&pool->lock);
+        centralFree(pool, cacheBlockStart(block));
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    *(void **)block = cache->bins[sizeClass];
+    cache->bins[sizeClass] = block;
+    if (++cache->binCounts[sizeClass] > CACHE_LIMIT){
+        pthread_mutex_lock(&pool->lock);
+        cacheDrain(cache, sizeClass, CACHE_LIMIT / 2);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ Gives every block cached by the calling thread back to the pool, and
+ empty slabs too, so the mem_pool_*() statistics count them as free again.
+ */
+void mem_pool_flush_cache(mem_pool_t *pool)
+{
+    struct threadCache *cache;
+    int sizeClass;
+
+    if (pool->arenas != NULL){
+        drainAllRemoteFrees(pool);
+        for (sizeClass = 0; sizeClass < pool->arenaCount; sizeClass++){
+            mem_pool_flush_cache(pool->arenas[sizeClass]);
+        }
+        return;
+    }
+    if (!(pool->flags & (MEM_THREAD_CACHE | MEM_SMALL_SLABS))){
+        return;
+    }
+    cache = pool->flags & MEM_THREAD_CACHE ? (struct threadCache *)pthread_getspecific(pool->cacheKey) : NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (cache != NULL){
+        for (sizeClass = 0; sizeClass < CACHE_CLASSES; sizeClass++){
+            cacheDrain(cache, sizeClass, cache->binCounts[sizeClass]);
+        }
+    }
+    slabReleaseEmpty(pool);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ Runs when a thread that used the pool exits: its blocks go back to the pool
+ and its cache is freed.
+ */
+void cacheRelease(void *data){
+    struct threadCache *cache = (struct threadCache *)data;
+    mem_pool_t *pool = cache->pool;
+    int sizeClass;
+
+    pthread_mutex_lock(&pool->lock);
+    for (sizeClass = 0; sizeClass < CACHE_CLASSES; sizeClass++){
+        cacheDrain(cache, sizeClass, cache->binCounts[sizeClass]);
+    }
+    if (cache->last != NULL){
+        cache->last->next = cache->next;
+    } else {
+        pool->caches = cache->next;
+    }
+    if (cache->next != NULL){
+        cache->next->last = cache->last;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(cache);
+}
+
+//-------------------Small slabs-------------------------------------------
+/**
+ Allocates a block of at most SLAB_MAX_SIZE bytes from a slab of its class,
+ taking a new slab from the pool if no slab of the class has room.
+ The caller holds pool->lock.
+ */
+void *slabMalloc(mem_pool_t *pool, size_t requested){
+    int sizeClass = requested > 16 ? (int)((requested - 1) / 16) : 0;
+    struct slab *slab = pool->slabs[sizeClass];
+    int word = 0;
+    int index;
+
+    if (slab == NULL && (slab = slabCreate(pool, sizeClass)) == NULL){
+        return NULL;
+    }
+    while (slab->bitmap[word] == UINT64_MAX){
+        word++;
+    }
+    index = word * 64 + __builtin_ctzll(~slab->bitmap[word]);
+    slab->bitmap[word] |= (uint64_t)1 << (index % 64);
+    if (++slab->used == slab->blocks){
+        slabUnlink(pool, slab); //Full until one of its blocks is freed
+    }
+    return (char *)slab + SLAB_HEADER + (size_t)index * slabBlockSize(slab);
+}
+
+/**
+ Takes a new, empty slab of the class from the pool and puts it on the
+ list of its class. Returns NULL if the pool has no room for it.
+ */
+struct slab *slabCreate(mem_pool_t *pool, int sizeClass){
+    struct slab *slab = (struct slab *)poolMalloc(pool, SLAB_SIZE, SLAB_SIZE);
+    int word;
+
+    if (slab == NULL){
+        return NULL;
+    }
+    allocTableFind(pool, slab)->slab = 1;
+    slab->sizeClass = (uint32_t)sizeClass;
+    slab->used = 0;
+    slab->blocks = (uint32_t)((SLAB_SIZE - SLAB_HEADER) / slabBlockSize(slab));
+    for (word = 0; word < SLAB_BITMAP_WORDS; word++){
+        //Blocks past the end of the slab look allocated, so the search never picks them
+        uint32_t first = (uint32_t)word * 64;
+        slab->bitmap[word] = slab->blocks >= first + 64 ? 0 : slab->blocks <= first ? UINT64_MAX : UINT64_MAX << (slab->blocks - first);
+    }
+    slabPush(pool, slab);
+    return slab;
+}
+
+/**
+ The slab that block was allocated from, or NULL if block isn't the start
+ of an allocated block of a slab.
+ */
+struct slab *slabOf(mem_pool_t *pool, void *block){
+    struct slab *slab = (struct slab *)((uintptr_t)block & ~(uintptr_t)(SLAB_SIZE - 1));
+    struct memoryList *node = allocTableFind(pool, slab);
+    int index;
+
+    if (node == NULL || !node->slab){
+        return NULL;
+    }
+    index = slabIndex(slab, block);
+    if (index < 0 || (char *)block != (char *)slab + SLAB_HEADER + (size_t)index * slabBlockSize(slab)
+        || !(slab->bitmap[index / 64] >> (index % 64) & 1)){
+        return NULL;
+    }
+    return slab;
+}
+
+/**
+ Frees a block of a slab. A slab that was full goes back on the list of
+ its class; one left empty goes back to the pool, unless no other slab of
+ its class has room. Returns 0 if block isn't an allocated block of a slab.
+ The caller holds pool->lock.
+ */
+int slabFree(mem_pool_t *pool, void *block){
+    struct slab *slab = slabOf(pool, block);
+    int index;
+
+    if (slab == NULL){
+        return 0;
+    }
+    index = slabIndex(slab, block);
+    slab->bitmap[index / 64] &= ~((uint64_t)1 << (index % 64));
+    if (slab->used-- == slab->blocks){
+        struct slab *next = pool->slabs[slab->sizeClass];
+        slabPush(pool, slab);
+        if (next != NULL && next->used == 0){
+            //An empty slab is only kept while it is the only one with room
+            slabRelease(pool, next);
+        }
+    } else if (slab->used == 0 && (slab->last != NULL || slab->next != NULL)){
+        slabRelease(pool, slab);
+    }
+    return 1;
+}
+
+/* Puts the slab at the front of the list of its class */
+void slabPush(mem_pool_t *pool, struct slab *slab){
+    slab->last = NULL;
+    slab->next = pool->slabs[slab->sizeClass];
+    if (slab->next != NULL){
+        slab->next->last = slab;
+    }
+    pool->slabs[slab->sizeClass] = slab;
+}
+
+void slabUnlink(mem_pool_t *pool, struct slab *slab){
+    if (slab->last != NULL){
+        slab->last->next = slab->next;
+    } else {
+        pool->slabs[slab->sizeClass] = slab->next;
+    }
+    if (slab->next != NULL){
+        slab->next->last = slab->last;
+    }
+    slab->last = slab->next = NULL;
+}
+
+/* Gives an empty slab back to the pool */
+void slabRelease(mem_pool_t *pool, struct slab *slab){
+    slabUnlink(pool, slab);
+    allocTableFind(pool, slab)->slab = 0;
+    centralFree(pool, slab);
+}
+
+/**
+ Gives back the empty slab each class may have kept. The caller holds pool->lock.
+ */
+void slabReleaseEmpty(mem_pool_t *pool){
+    int sizeClass;
+
+    for (sizeClass = 0; sizeClass < SLAB_CLASSES; sizeClass++){
+        if (pool->slabs[sizeClass] != NULL && pool->slabs[sizeClass]->used == 0){
+            slabRelease(pool, pool->slabs[sizeClass]);
+        }
+    }
+}
+
+size_t slabBlockSize(struct slab *slab){
+    return ((size_t)slab->sizeClass + 1) * 16;
+}
+
+/**
+ Number of the block of the slab that holds ptr, or -1 if ptr is in the
+ header or past the last block.
+ */
+int slabIndex(struct slab *slab, void *ptr){
+    size_t offset = (size_t)((char *)ptr - (char *)slab);
+    size_t index;
+
+    if (offset < SLAB_HEADER){
+        return -1;
+    }
+    index = (offset - SLAB_HEADER) / slabBlockSize(slab);
+    return index < slab->blocks ? (int)index : -1;
+}
+
+//-------------------Arenas------------------------------------------------
+/* Round-robin number of the calling thread, taken from nextThreadArena
+ * the first time it allocates. Its arena is this modulo the arena count.
+ */
+_Thread_local int threadArena = -1;
+atomic_int nextThreadArena = 0;
+
+/**
+ Allocates from the calling thread's arena, or else from the arenas after it
+ */
+void *arenaMalloc(mem_pool_t *pool, size_t alignment, size_t requested){
+    int home = homeArena(pool);
+    int i;
+
+    if (pool->flags & MEM_REMOTE_FREE){
+        requested = remoteFreeSize(requested);
+    }
+    for (i = 0; i < pool->arenaCount; i++){
+        mem_pool_t *arena = pool->arenas[(home + i) % pool->arenaCount];
+        void *ptr;
+        drainRemoteFrees(arena);
+        ptr = mem_pool_malloc_aligned(arena, alignment, requested);
+        if (ptr != NULL){
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/**
+ Index of the calling thread's arena
+ */
+int homeArena(mem_pool_t *pool){
+    if (threadArena < 0){
+        threadArena = atomic_fetch_add(&nextThreadArena, 1);
+    }
+    return threadArena % pool->arenaCount;
+}
+
+/**
+ The arena whose memory holds ptr, or NULL if ptr is outside the pool
+ */
+mem_pool_t *arenaOf(mem_pool_t *pool, void *ptr){
+    size_t index;
+
+    if (ptr < pool->memory || (char *)ptr >= (char *)pool->memory + pool->size){
+        return NULL;
+    }
+    index = (size_t)((char *)ptr - (char *)pool->memory) / pool->arenaSize;
+    return pool->arenas[index < (size_t)pool->arenaCount ? index : (size_t)pool->arenaCount - 1];
+}
+
+int arenaSum(mem_pool_t *pool, int (*stat)(mem_pool_t *arena)){
+    int total = 0;
+    int i;
+    for (i = 0; i < pool->arenaCount; i++){
+        total += stat(pool->arenas[i]);
+    }
+    return total;
+}
+
+//-------------------Remote frees------------------------------------------
+/**
+ Hands a block to the arena that owns it without taking its lock.
+ A lock-free push onto a stack with many producers and one consumer.
+ */
+void pushRemoteFree(mem_pool_t *arena, void *block){
+    void *head = atomic_load_explicit(&arena->remoteFrees, memory_order_relaxed);
+    do {
+        *(void **)block = head;
+    } while (!atomic_compare_exchange_weak_explicit(&arena->remoteFrees, &head, block,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/**
+ Frees every block pushed to the arena by other threads, in one batch under its lock.
+ Taking the whole stack with one exchange leaves no ABA problem.
+ */
+void drainRemoteFrees(mem_pool_t *arena){
+    void *block;
+
+    if (atomic_load_explicit(&arena->remoteFrees, memory_order_relaxed) == NULL){
+        return;
+    }
+    pthread_mutex_lock(&arena->lock);
+    block = atomic_exchange_explicit(&arena->remoteFrees, NULL, memory_order_acquire);
+    while (block != NULL){
+        void *next = *(void **)block;
+        //Cached blocks go straight back to the pool, past the thread caches
+        centralFree(arena, arena->flags & MEM_THREAD_CACHE ? cacheBlockStart(block) : block);
+        block = next;
+    }
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ Size of a block of a MEM_REMOTE_FREE pool: room for the remote free link,
+ rounded up to whole links. With every block a multiple of the link size
+ and the arenas 16-byte aligned, every block starts where the link can be
+ stored aligned.
+ */
+size_t remoteFreeSize(size_t requested){
+    if (requested < sizeof(void *)){
+        return sizeof(void *);
+    }
+    return (requested + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+}
+
+void drainAllRemoteFrees(mem_pool_t *pool){
+    int i;
+    for (i = 0; i < pool->arenaCount; i++){
+        drainRemoteFrees(pool->arenas[i]);
+    }
+}
+
+//-------------------Buddy system------------------------------------------
+/*
+ * With the Buddy strategy every block is a power of two in size and
+ * starts at a multiple of its size from the pool memory. A block of size s
+ * at offset o was split from the block of size 2s at o & ~s, and its buddy
+ * is the other half, at o ^ s. The buddy is always a list neighbor, so a
+ * freed block merges with it (and the result with its own buddy) without
+ * any search: O(log n) merges for a pool of n bytes.
+ *
+ * A pool whose size is not a power of two starts out as the largest
+ * powers of two that fit, from the front, e.g. 500 = 256 + 128 + 64 +
+ * 32 + 16 + 4. The buddy of each of these lies in the next, smaller,
+ * block, so they never merge with each other. Memory added to a growing
+ * pool is split the same way, except that each block is also kept at a
+ * multiple of its size; those blocks can merge with their buddies.
+ */
+
+/**
+ Splits a free node into power-of-two blocks, each at a multiple of its size
+ */
+void buddyInit(mem_pool_t *pool, struct memoryList *node){
+    if (isFreeIndexed(node)){
+        unindexFreeNode(pool, node);
+    }
+    //The empty hole of a 0 byte pool has no power of two to split into
+    while (node->size != 0){
+        size_t offset = (size_t)((char *)node->ptr - (char *)pool->memory);
+        size_t top = (size_t)1 << tlsfHighestBit(node->size);
+        struct memoryList *rest;
+
+        if (offset != 0 && (offset & -offset) < top){
+            top = offset & -offset;
+        }
+        if (top == node->size){
+            break;
+        }
+        rest = newNode(pool);
+        if (rest == NULL){
+            break;
+        }
+        rest->size = node->size - top;
+        rest->alloc = 0;
+        rest->ptr = node->ptr + top;
+        node->size = top;
+        insertNodeAfter(pool, node, rest);
+        indexFreeNode(pool, node);
+        node = rest;
+    }
+    indexFreeNode(pool, node);
+}
+
+/**
+ Halves a free node that is not in the free indexes.
+ The upper half becomes a new, indexed free node.
+ Returns 0 if no node could be made for it.
+ */
+int buddySplit(mem_pool_t *pool, struct memoryList *node){
+    struct memoryList *upper = newNode(pool);
+
+    if (upper == NULL){
+        return 0;
+    }
+    node->size /= 2;
+    upper->size = node->size;
+    upper->alloc = 0;
+    upper->ptr = node->ptr + node->size;
+    insertNodeAfter(pool, node, upper);
+    indexFreeNode(pool, upper);
+    return 1;
+}
+
+/**
+ Frees an allocated node and merges it with its buddy for as long as the
+ buddy is free and whole
+ */
+void buddyFreeNode(mem_pool_t *pool, struct memoryList *node){
+    allocTableRemove(pool, node);
+    pool->allocatedBytes -= node->size;
+    pool->requestedBytes -= node->requested;
+    node->alloc = 0;
+
+    for (;;){
+        size_t offset = (size_t)((char *)node->ptr - (char *)pool->memory);
+        size_t buddyOffset = offset ^ node->size;
+        struct memoryList *buddy = buddyOffset > offset ? node->next : node->last;
+
+        if (buddy == NULL || buddy->alloc || buddy->size != node->size
+            || (size_t)((char *)buddy->ptr - (char *)pool->memory) != buddyOffset){
+            break;
+        }
+        node = buddyOffset > offset ? mergeFreeNodes(pool, node, buddy) : mergeFreeNodes(pool, buddy, node);
+    }
+    indexFreeNode(pool, node);
+    releaseHole(pool, node->ptr, node->size, 0, 0);
+}
+
+//-------------------Node start table--------------------------------------
+/**
+ Puts node in nodesByAddress, or for TLSF in startTable. node is linked
+ into the list already.
+ */
+void addressInsert(mem_pool_t *pool, struct memoryList *node){
+    if (keepsAddressTree(pool)){
+        treeInsert(&pool->nodesByAddress, &node->byAddress);
+    } else {
+        startTableInsert(pool, node);
+    }
+}
+
+/**
+ Takes node out of nodesByAddress or startTable, while it is still linked
+ */
+void addressRemove(mem_pool_t *pool, struct memoryList *node){
+    if (keepsAddressTree(pool)){
+        treeRemove(&pool->nodesByAddress, &node->byAddress);
+    } else {
+        startTableRemove(pool, node);
+    }
+}
+
+/**
+ Makes room in startTable for every chunk of the pool, new entries NULL,
+ and lays out startBits again for the new number of chunks.
+ Returns 0 if the memory for them can't be allocated.
+ */
+int startTableResize(mem_pool_t *pool){
+    size_t chunks = pool->size / START_CHUNK + 1; //A node may start at the very end
+    uint64_t *bits[START_LEVELS] = {NULL};
+    struct memoryList **table;
+    size_t count = chunks;
+    size_t chunk;
+    int levels = 0;
+    int level;
+
+    if (chunks <= pool->startChunks){
+        return 1;
+    }
+    do {
+        count = (count + 63) / 64;
+        bits[levels] = (uint64_t *)calloc(count, sizeof(uint64_t));
+        if (bits[levels++] == NULL){
+            while (levels > 0){
+                free(bits[--levels]);
+            }
+            return 0;
+        }
+    } while (count > 1);
+    table = (struct memoryList **)realloc(pool->startTable, chunks * sizeof(struct memoryList *));
+    if (table == NULL){
+        while (levels > 0){
+            free(bits[--levels]);
+        }
+        return 0;
+    }
+    memset(table + pool->startChunks, 0, (chunks - pool->startChunks) * sizeof(struct memoryList *));
+    for (level = 0; level < START_LEVELS; level++){
+        free(pool->startBits[level]);
+        pool->startBits[level] = bits[level];
+    }
+    pool->startTable = table;
+    pool->startLevels = levels;
+    for (chunk = 0; chunk < pool->startChunks; chunk++){
+        if (table[chunk] != NULL){
+            startBitSet(pool, chunk);
+        }
+    }
+    pool->startChunks = chunks;
+    return 1;
+}
+
+size_t startChunkOf(mem_pool_t *pool, void *ptr){
+    return (size_t)((char *)ptr - (char *)pool->memory) / START_CHUNK;
+}
+
+/**
+ Makes node the entry of its chunk if it is the lowest node there. Of two
+ nodes at the same address, the one first in the list is the lower.
+ */
+void startTableInsert(mem_pool_t *pool, struct memoryList *node){
+    size_t chunk = startChunkOf(pool, node->ptr);
+    struct memoryList *lowest = pool->startTable[chunk];
+
+    if (lowest == NULL){
+        pool->startTable[chunk] = node;
+        startBitSet(pool, chunk);
+    } else if (node->ptr < lowest->ptr || node->next == lowest){
+        pool->startTable[chunk] = node;
+    }
+}
+
+/**
+ Hands the entry of node's chunk on to the next node if node has it.
+ node must still be linked.
+ */
+void startTableRemove(mem_pool_t *pool, struct memoryList *node){
+    size_t chunk = startChunkOf(pool, node->ptr);
+
+    if (pool->startTable[chunk] != node){
+        return;
+    }
+    if (node->next != NULL && startChunkOf(pool, node->next->ptr) == chunk){
+        pool->startTable[chunk] = node->next;
+    } else {
+        pool->startTable[chunk] = NULL;
+        startBitClear(pool, chunk);
+    }
+}
+
+/**
+ The node holding ptr. Either a node starts in its chunk at or before ptr,
+ or the one holding it is the last that starts before the chunk: the one
+ before the chunk's lowest node, or else found through startBits. Either
+ way no more than the nodes starting in one chunk are walked.
+ */
+struct memoryList *startTableHolding(mem_pool_t *pool, void *ptr){
+    size_t chunk = startChunkOf(pool, ptr);
+    struct memoryList *node;
+
+    if (chunk >= pool->startChunks){
+        chunk = pool->startChunks - 1;
+    }
+    node = pool->startTable[chunk];
+    if (node != NULL && node->ptr > ptr){
+        return node->last;
+    }
+    if (node == NULL){
+        chunk = startBitPrev(pool, chunk);
+        if (chunk == SIZE_MAX){
+            return NULL;
+        }
+        node = pool->startTable[chunk];
+    }
+    while (node->next != NULL && node->next->ptr <= ptr){
+        node = node->next;
+    }
+    return node;
+}
+
+void startBitSet(mem_pool_t *pool, size_t chunk){
+    int level;
+
+    for (level = 0; level < pool->startLevels; level++){
+        uint64_t *word = &pool->startBits[level][chunk / 64];
+        uint64_t was = *word;
+
+        *word |= (uint64_t)1 << (chunk % 64);
+        if (was != 0){
+            break; //The levels above know already
+        }
+        chunk /= 64;
+    }
+}
+
+void startBitClear(mem_pool_t *pool, size_t chunk){
+    int level;
+
+    for (level = 0; level < pool->startLevels; level++){
+        uint64_t *word = &pool->startBits[level][chunk / 64];
+
+        *word &= ~((uint64_t)1 << (chunk % 64));
+        if (*word != 0){
+            break;
+        }
+        chunk /= 64;
+    }
+}
+
+/**
+ The highest chunk up to and including chunk where a node starts, or
+ SIZE_MAX if there is none. Climbs while the words up to there are empty,
+ then takes the highest set bit on the way down.
+ */
+size_t startBitPrev(mem_pool_t *pool, size_t chunk){
+    int level = 0;
+
+    for (;;){
+        uint64_t below = chunk % 64 == 63 ? UINT64_MAX : ((uint64_t)2 << (chunk % 64)) - 1;
+        uint64_t bits = pool->startBits[level][chunk / 64] & below;
+
+        if (bits != 0){
+            chunk = chunk / 64 * 64 + 63 - (size_t)__builtin_clzll(bits);
+            break;
+        }
+        if (chunk / 64 == 0 || ++level == pool->startLevels){
+            return SIZE_MAX;
+        }
+        chunk = chunk / 64 - 1;
+    }
+    while (level > 0){
+        level--;
+        chunk = chunk * 64 + 63 - (size_t)__builtin_clzll(pool->startBits[level][chunk]);
+    }
+    return chunk;
+}
+
+//-------------------Granule bitmap----------------------------------------
+/*
+ * The bits of a Bitmap pool mirror its nodes: the granules of allocated
+ * nodes are set and those of free nodes clear, so every hole is a maximal
+ * run of clear bits. A partial granule at the end of the pool is never
+ * handed out and stays clear. The nodes are still kept, for the
+ * statistics and for everything that works on blocks; the bitmap replaces
+ * the search for a free node, and answers mem_is_alloc() with one bit.
+ */
+
+size_t granuleCount(size_t bytes){
+    return (bytes + GRANULE_SIZE - 1) / GRANULE_SIZE;
+}
+
+/**
+ Makes room for a bit per granule of the pool, new bits clear.
+ Returns 0 if the memory for them can't be allocated.
+ */
+int granuleResize(mem_pool_t *pool){
+    size_t words = (granuleCount(pool->size) + 63) / 64;
+    uint64_t *granules;
+
+    if (words <= pool->granuleWords){
+        return 1;
+    }
+    granules = (uint64_t *)realloc(pool->granules, words * sizeof(uint64_t));
+    if (granules == NULL){
+        return 0;
+    }
+    memset(granules + pool->granuleWords, 0, (words - pool->granuleWords) * sizeof(uint64_t));
+    pool->granules = granules;
+    pool->granuleWords = words;
+    return 1;
+}
+
+/**
+ Sets or clears the bits of the granules of size bytes at ptr.
+ Does nothing for pools without a bitmap.
+ */
+void granuleMark(mem_pool_t *pool, void *ptr, size_t size, int allocated){
+    size_t first;
+    size_t end;
+
+    if (pool->granules == NULL){
+        return;
+    }
+    first = (size_t)((char *)ptr - (char *)pool->memory) / GRANULE_SIZE;
+    end = first + granuleCount(size);
+    if (!allocated && first / 64 < pool->granuleHint){
+        pool->granuleHint = first / 64;
+    }
+    while (first < end){
+        size_t bits = end - first < 64 - first % 64 ? end - first : 64 - first % 64;
+        uint64_t mask = (bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1) << (first % 64);
+
+        if (allocated){
+            pool->granules[first / 64] |= mask;
+        } else {
+            pool->granules[first / 64] &= ~mask;
+        }
+        first += bits;
+    }
+}
+
+char granuleTest(mem_pool_t *pool, void *ptr){
+    size_t granule = (size_t)((char *)ptr - (char *)pool->memory) / GRANULE_SIZE;
+    return (char)(pool->granules[granule / 64] >> (granule % 64) & 1);
+}
+
+/**
+ First granule of the lowest run of count clear bits among the first
+ limit granules, or limit if there is none. Words that are all set, and
+ the all clear words in the middle of a long run, are passed over with
+ granuleSkip(), and words too crowded for a short run with granuleScan();
+ the others are looked at a word at a time.
+ */
+size_t granuleFind(mem_pool_t *pool, size_t count, size_t limit){
+    const uint64_t *words = pool->granules;
+    size_t full = limit / 64; //Words with all of their granules below limit
+    size_t wordCount = (limit + 63) / 64;
+    size_t run = 0;           //Clear bits at the end of the words looked at so far
+    size_t start = 0;         //Where they start
+    size_t i = granuleSkip(words, pool->granuleHint < full ? pool->granuleHint : full, full, UINT64_MAX);
+
+    pool->granuleHint = i;
+    while (i < wordCount){
+        uint64_t word;
+
+        if (run == 0 && count <= GRANULE_SHORT_RUN){
+            i = granuleScan(words, i, full, count);
+            if (i >= wordCount){
+                break;
+            }
+        }
+        word = words[i];
+
+        if (i >= full){
+            word |= UINT64_MAX << (limit % 64); //Granules from limit on can't be used
+        }
+        if (word == UINT64_MAX){
+            run = 0;
+            i = granuleSkip(words, i + 1, full, UINT64_MAX);
+            continue;
+        }
+        if (word == 0){
+            size_t next;
+
+            if (run == 0){
+                start = i * 64;
+            }
+            if (run + 64 >= count){
+                return start;
+            }
+            next = granuleSkip(words, i + 1, full, 0);
+            run += (next - i) * 64;
+            if (run >= count){
+                return start;
+            }
+            i = next;
+            continue;
+        }
+        if (run + (size_t)__builtin_ctzll(word) >= count){
+            return run > 0 ? start : i * 64;
+        }
+        if (count < 64){
+            uint64_t fits = granuleRuns(~word, count);
+            if (fits != 0){
+                return i * 64 + __builtin_ctzll(fits);
+            }
+        }
+        run = __builtin_clzll(word);
+        start = i * 64 + 64 - run;
+        i++;
+    }
+    return limit;
+}
+
+/**
+ Bit j of the result is set if bits j to j + count - 1 of clear are all
+ set, i.e. if a run of count clear granules starts at j within the word
+ */
+uint64_t granuleRuns(uint64_t clear, size_t count){
+    size_t length = 1;
+
+    while (length < count){
+        size_t shift = length < count - length ? length : count - length;
+        clear &= clear >> shift;
+        length += shift;
+    }
+    return clear;
+}
+
+/**
+ Index of the first of words[from] to words[to - 1] that isn't value, or to
+ */
+size_t granuleSkipScalar(const uint64_t *words, size_t from, size_t to, uint64_t value){
+    while (from < to && words[from] == value){
+        from++;
+    }
+    return from;
+}
+
+/**
+ The first word from words[from] on that a run of count clear bits,
+ count <= GRANULE_SHORT_RUN, may start in; to if there is none before.
+ Such a run lies within a word, or within the upper half of one and the
+ lower half of the next.
+ */
+size_t granuleScanScalar(const uint64_t *words, size_t from, size_t to, size_t count){
+    for (; from + 1 < to; from++){
+        uint64_t straddle = words[from] >> 32 | words[from + 1] << 32;
+        if (granuleRuns(~words[from], count) != 0 || granuleRuns(~straddle, count) != 0){
+            return from;
+        }
+    }
+    return from;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* granuleSkipScalar() two words per compare */
+__attribute__((target("sse2")))
+size_t granuleSkipSse2(const uint64_t *words, size_t from, size_t to, uint64_t value){
+    __m128i pattern = _mm_set1_epi64x((long long)value);
+
+    while (from + 2 <= to){
+        int equal = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(words + from)), pattern));
+        if (equal != 0xFFFF){
+            return from + __builtin_ctz(~(unsigned)equal) / 8;
+        }
+        from += 2;
+    }
+    return granuleSkipScalar(words, from, to, value);
+}
+
+/* granuleScanScalar() two words at a time */
+__attribute__((target("sse2")))
+size_t granuleScanSse2(const uint64_t *words, size_t from, size_t to, size_t count){
+    __m128i ones = _mm_set1_epi32(-1);
+
+    while (from + 3 <= to){
+        __m128i here = _mm_loadu_si128((const __m128i *)(words + from));
+        __m128i next = _mm_loadu_si128((const __m128i *)(words + from + 1));
+        __m128i clear = _mm_xor_si128(here, ones);
+        __m128i straddle = _mm_xor_si128(_mm_or_si128(_mm_srli_epi64(here, 32), _mm_slli_epi64(next, 32)), ones);
+        size_t length = 1;
+
+        while (length < count){
+            size_t shift = length < count - length ? length : count - length;
+            __m128i bits = _mm_cvtsi32_si128((int)shift);
+            clear = _mm_and_si128(clear, _mm_srl_epi64(clear, bits));
+            straddle = _mm_and_si128(straddle, _mm_srl_epi64(straddle, bits));
+            length += shift;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(clear, straddle), _mm_setzero_si128())) != 0xFFFF){
+            break; //One of the two words has a run; the scalar scan says which
+        }
+        from += 2;
+    }
+    return granuleScanScalar(words, from, to, count);
+}
+
+/* granuleSkipScalar() four words per compare */
+__attribute__((target("avx2")))
+size_t granuleSkipAvx2(const uint64_t *words, size_t from, size_t to, uint64_t value){
+    __m256i pattern = _mm256_set1_epi64x((long long)value);
+
+    while (from + 4 <= to){
+        unsigned equal = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(words + from)), pattern));
+        if (equal != 0xFFFFFFFFu){
+            return from + __builtin_ctz(~equal) / 8;
+        }
+        from += 4;
+    }
+    return granuleSkipScalar(words, from, to, value);
+}
+
+/* granuleScanScalar() four words at a time */
+__attribute__((target("avx2")))
+size_t granuleScanAvx2(const uint64_t *words, size_t from, size_t to, size_t count){
+    __m256i ones = _mm256_set1_epi32(-1);
+
+    while (from + 5 <= to){
+        __m256i here = _mm256_loadu_si256((const __m256i *)(words + from));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(words + from + 1));
+        __m256i clear = _mm256_xor_si256(here, ones);
+        __m256i straddle = _mm256_xor_si256(_mm256_or_si256(_mm256_srli_epi64(here, 32), _mm256_slli_epi64(next, 32)), ones);
+        __m256i found;
+        size_t length = 1;
+
+        while (length < count){
+            size_t shift = length < count - length ? length : count - length;
+            __m128i bits = _mm_cvtsi32_si128((int)shift);
+            clear = _mm256_and_si256(clear, _mm256_srl_epi64(clear, bits));
+            straddle = _mm256_and_si256(straddle, _mm256_srl_epi64(straddle, bits));
+            length += shift;
+        }
+        found = _mm256_or_si256(clear, straddle);
+        if (!_mm256_testz_si256(found, found)){
+            break; //One of the four words has a run; the scalar scan says which
+        }
+        from += 4;
+    }
+    return granuleScanScalar(words, from, to, count);
+}
+#endif
+
+/**
+ Picks the widest granuleSkip() and granuleScan() the CPU supports.
+ Run once, by the first Bitmap pool.
+ */
+void granuleSelect(void){
+    granuleSkip = granuleSkipScalar;
+    granuleScan = granuleScanScalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        granuleSkip = granuleSkipAvx2;
+        granuleScan = granuleScanAvx2;
+    } else if (__builtin_cpu_supports("sse2")){
+        granuleSkip = granuleSkipSse2;
+        granuleScan = granuleScanSse2;
+    }
+#endif
+}
+
+/**
+ Holes counted from the bitmap: a clear bit after a set one (or at the
+ start) starts one. For checking pool->holeCount.
+ */
+int granuleHoles(mem_pool_t *pool){
+    size_t bits = granuleCount(pool->size);
+    uint64_t before = 1; //Bit -1, as if allocated
+    int holes = 0;
+    size_t i;
+
+    for (i = 0; i < (bits + 63) / 64; i++){
+        uint64_t word = pool->granules[i];
+        if (i == bits / 64){
+            word |= UINT64_MAX << (bits % 64); //Past the end, as if allocated
+        }
+        holes += __builtin_popcountll(~word & (word << 1 | before));
+        before = word >> 63;
+    }
+    return holes;
+}
+
+/* Allocated bytes counted from the bitmap, for checking pool->allocatedBytes */
+int granuleAllocated(mem_pool_t *pool){
+    int granules = 0;
+    size_t i;
+
+    for (i = 0; i < pool->granuleWords; i++){
+        granules += __builtin_popcountll(pool->granules[i]);
+    }
+    return granules * GRANULE_SIZE;
+}
+
+//-------------------Resizing----------------------------------------------
+/**
+ Resizes a block in place if possible. Returns 0 if it has to move.
+ The caller holds pool->lock.
+ */
+int centralResize(mem_pool_t *pool, void *block, size_t requested){
+    struct memoryList *node;
+
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        return tagResize(pool, block, requested);
+    }
+    node = allocTableFind(pool, block);
+    if (node == NULL || node->slab){
+        //A small block keeps the size of its class
+        struct slab *slab = node == NULL && pool->flags & MEM_SMALL_SLABS ? slabOf(pool, block) : NULL;
+        return slab != NULL && requested <= slabBlockSize(slab);
+    }
+    if (pool->strategy == Buddy){
+        return buddyResize(pool, node, requested);
+    }
+    if (pool->strategy == Bitmap){
+        //Whole granules, as allocated
+        size_t size = granuleCount(requested > 0 ? requested : 1) * GRANULE_SIZE;
+
+        if (size < node->size){
+            shrinkNode(pool, node, size);
+        } else if (size > node->size){
+            if (node->next == NULL || node->next->alloc != 0 || node->size + node->next->size < size){
+                return 0;
+            }
+            growNode(pool, node, size);
+        }
+        pool->requestedBytes += requested - node->requested;
+        node->requested = requested;
+        return 1;
+    }
+    if (requested < node->size){
+        shrinkNode(pool, node, requested);
+        return 1;
+    }
+    if (requested == node->size){
+        return 1;
+    }
+    if (node->next != NULL && node->next->alloc == 0 && node->size + node->next->size >= requested){
+        growNode(pool, node, requested);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ Usable bytes of an allocated block that may be moved to another address,
+ so 0 for a handle block. The caller holds pool->lock.
+ */
+size_t centralBlockSize(mem_pool_t *pool, void *block){
+    struct memoryList *node;
+
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        return tagSize(pool, (size_t)((char *)block - (char *)pool->memory) - TAG_SIZE) - TAG_OVERHEAD;
+    }
+    node = allocTableFind(pool, block);
+    if (node == NULL && pool->flags & MEM_SMALL_SLABS){
+        struct slab *slab = slabOf(pool, block);
+        return slab != NULL ? slabBlockSize(slab) : 0;
+    }
+    return node && !node->slab && node->handle == 0 ? node->size : 0;
+}
+
+/**
+ Gives the end of an allocated node back as a free node, merged with the
+ free node after it if there is one
+ */
+void shrinkNode(mem_pool_t *pool, struct memoryList *node, size_t requested){
+    struct memoryList *tail = newNode(pool);
+
+    if (tail == NULL){
+        return; //Keep the whole block; it is still big enough
+    }
+    tail->size = node->size - requested;
+    tail->alloc = 0;
+    tail->ptr = node->ptr + requested;
+    granuleMark(pool, tail->ptr, tail->size, 0);
+    pool->allocatedBytes -= tail->size;
+    node->size = requested;
+    insertNodeAfter(pool, node, tail);
+    if (tail->next != NULL && tail->next->alloc == 0){
+        mergeFreeNodes(pool, tail, tail->next);
+    }
+    indexFreeNode(pool, tail);
+    releaseHole(pool, tail->ptr, tail->size, 0, 0);
+}
+
+/**
+ Grows an allocated node into the free node after it, which must be large enough
+ */
+void growNode(mem_pool_t *pool, struct memoryList *node, size_t requested){
+    struct memoryList *next = node->next;
+    size_t needed = requested - node->size;
+
+    granuleMark(pool, next->ptr, needed, 1);
+    unindexFreeNode(pool, next);
+    if (next->size == needed){
+        removeNode(pool, next);
+    } else {
+        //Moving its start keeps next between the same neighbors, so its place by address holds,
+        //but it may start in another chunk of startTable
+        if (!keepsAddressTree(pool)){
+            startTableRemove(pool, next);
+        }
+        next->ptr += needed;
+        if (!keepsAddressTree(pool)){
+            startTableInsert(pool, next);
+        }
+        next->size -= needed;
+        indexFreeNode(pool, next);
+    }
+    node->size = requested;
+    pool->allocatedBytes += needed;
+}
+
+/**
+ Buddy blocks shrink by giving back upper halves, and grow by taking over
+ their buddy while they are the lower half and the buddy is free and whole
+ */
+int buddyResize(mem_pool_t *pool, struct memoryList *node, size_t requested){
+    while (node->size / 2 >= requested && node->size > 1){
+        if (!buddySplit(pool, node)){
+            break;
+        }
+        pool->allocatedBytes -= node->size;
+    }
+    while (node->size < requested){
+        size_t offset = (size_t)((char *)node->ptr - (char *)pool->memory);
+        struct memoryList *buddy = node->next;
+
+        if ((offset & node->size) != 0 || buddy == NULL || buddy->alloc || buddy->size != node->size){
+            return 0; //Whatever was merged so far is freed with the block when it moves
+        }
+        unindexFreeNode(pool, buddy);
+        removeNode(pool, buddy);
+        pool->allocatedBytes += node->size;
+        node->size *= 2;
+    }
+    pool->requestedBytes += requested - node->requested;
+    node->requested = requested;
+    return 1;
+}
+
+/**
+ Resizes a tagged block in place: the end of a shrinking block, or the
+ rest of the free block after a growing one, becomes a free block.
+ */
+int tagResize(mem_pool_t *pool, void *ptr, size_t requested){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t block = (size_t)((char *)ptr - (char *)pool->memory) - TAG_SIZE;
+    size_t blockSize = tagSize(pool, block);
+    size_t next = block + blockSize;
+    size_t size;
+    size_t available = blockSize;
+
+    if (requested > pool->size){
+        return 0;
+    }
+    size = (requested + TAG_OVERHEAD + TAG_ALIGN - 1) / TAG_ALIGN * TAG_ALIGN;
+    if (size < TAG_MIN_BLOCK){
+        size = TAG_MIN_BLOCK;
+    }
+    if (next < header->end && !tagIsAlloc(pool, next)){
+        available += tagSize(pool, next);
+    }
+    if (available < size){
+        return 0;
+    }
+    if (available > blockSize){
+        if (size <= blockSize && blockSize - size < TAG_MIN_BLOCK){
+            return 1; //Nothing worth giving back
+        }
+        tagUnlinkFree(pool, next);
+    } else if (available - size < TAG_MIN_BLOCK){
+        return 1;
+    }
+    if (available - size < TAG_MIN_BLOCK){
+        size = available;
+    } else {
+        //The free rest is written before the block changes size
+        tagWrite(pool, block + size, available - size, 0);
+        tagPushFree(pool, block + size);
+    }
+    tagWrite(pool, block, size, 1);
+    header->allocated += size - blockSize;
+    return 1;
+}
+
+//-------------------Batches-----------------------------------------------
+/**
+ mem_pool_malloc_batch() without the thread caches. The caller holds pool->lock.
+ Buddy and Bitmap blocks are rounded up, so they can't be carved from one
+ block; those strategies allocate them one by one.
+ */
+int centralMallocBatch(mem_pool_t *pool, size_t size, void **out, int n){
+    int count = 0;
+
+    if (n > 1 && pool->strategy != Buddy && pool->strategy != Bitmap && size <= pool->size / n
+        && !(pool->flags & MEM_SMALL_SLABS && size <= SLAB_MAX_SIZE)){
+        count = pool->flags & MEM_BOUNDARY_TAGS ? tagMallocBatch(pool, size, out, n) : listMallocBatch(pool, size, out, n);
+    }
+    while (count < n && (out[count] = centralMalloc(pool, 1, size)) != NULL){
+        count++;
+    }
+    return count;
+}
+
+/**
+ Allocates one node for all n blocks with the pool strategy, then splits
+ it into n allocated nodes. Returns 0 if no hole is large enough.
+ */
+int listMallocBatch(mem_pool_t *pool, size_t size, void **out, int n){
+    struct memoryList *node;
+    int i;
+
+    out[0] = poolMalloc(pool, 1, size * n);
+    if (out[0] == NULL){
+        return 0;
+    }
+    node = allocTableFind(pool, out[0]);
+    for (i = 1; i < n; i++){
+        struct memoryList *piece = newNode(pool);
+        if (piece == NULL){
+            shrinkNode(pool, node, size); //Give back what is left
+            return i;
+        }
+        piece->last = NULL;
+        piece->next = NULL;
+        piece->size = node->size - size;
+        piece->alloc = 1;
+        piece->ptr = node->ptr + size;
+        node->size = size;
+        insertNodeAfter(pool, node, piece);
+        allocTableInsert(pool, piece);
+        out[i] = piece->ptr;
+        node = piece;
+    }
+    //As if the blocks had been allocated one after the other
+    setLastVisited(pool, node);
+    return n;
+}
+
+/**
+ Allocates one tagged block for all n blocks, then writes the tags of the
+ n blocks into it. They are written from the last to the first, so the
+ block keeps its original header until all the others are in place.
+ */
+int tagMallocBatch(mem_pool_t *pool, size_t size, void **out, int n){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t blockSize = (size + TAG_OVERHEAD + TAG_ALIGN - 1) / TAG_ALIGN * TAG_ALIGN;
+    size_t block;
+    size_t total;
+    int i;
+
+    if (blockSize < TAG_MIN_BLOCK){
+        blockSize = TAG_MIN_BLOCK;
+    }
+    out[0] = tagMalloc(pool, blockSize * n - TAG_OVERHEAD);
+    if (out[0] == NULL){
+        return 0;
+    }
+    block = (size_t)((char *)out[0] - (char *)pool->memory) - TAG_SIZE;
+    total = tagSize(pool, block);
+    header->allocated -= total - TAG_OVERHEAD;
+    for (i = n - 1; i >= 0; i--){
+        //The last block also takes any rest too small to be free on its own
+        size_t pieceSize = i < n - 1 ? blockSize : total - (n - 1) * blockSize;
+        size_t piece = block + i * blockSize;
+        tagWrite(pool, piece, pieceSize, 1);
+        header->allocated += pieceSize - TAG_OVERHEAD;
+        out[i] = (char *)pool->memory + piece + TAG_SIZE;
+    }
+    return n;
+}
+
+/**
+ Frees the blocks at the sorted addresses in ptrs in one pass. A run of
+ blocks that follow each other in the list is merged into one free node,
+ which is then merged with its free neighbors and indexed once.
+ The caller holds pool->lock.
+ */
+void listFreeBatch(mem_pool_t *pool, void **ptrs, int n){
+    int i = 0;
+
+    while (i < n){
+        struct memoryList *node = allocTableFind(pool, ptrs[i++]);
+
+        if (node == NULL && pool->flags & MEM_SMALL_SLABS && slabFree(pool, ptrs[i - 1])){
+            continue;
+        }
+        if (node == NULL || node->handle != 0 || node->slab){
+            if (debugMessages){
+                printf("Myfree didn't find the node it was looking for\n");
+            }
+            continue;
+        }
+        allocTableRemove(pool, node);
+        pool->allocatedBytes -= node->size;
+        node->alloc = 0;
+        while (i < n && node->next != NULL && node->next->alloc && node->next->ptr == ptrs[i]){
+            struct memoryList *next = node->next;
+            allocTableRemove(pool, next);
+            pool->allocatedBytes -= next->size;
+            next->alloc = 0;
+            mergeFreeNodes(pool, node, next);
+            i++;
+        }
+        if (node->last != NULL && node->last->alloc == 0){
+            node = mergeFreeNodes(pool, node->last, node);
+        }
+        if (node->next != NULL && node->next->alloc == 0){
+            mergeFreeNodes(pool, node, node->next);
+        }
+        indexFreeNode(pool, node);
+        releaseHole(pool, node->ptr, node->size, 0, 0);
+    }
+}
+
+//-------------------Growing-----------------------------------------------
+/**
+ Commits at least needed more bytes of a MEM_GROWABLE pool's reservation,
+ and at least as many as the pool has, so it takes O(log n) growths to
+ reach n bytes. The new memory joins the free tail or becomes a new free
+ node. Returns 0 if the reservation has no room left.
+ The caller holds pool->lock.
+ */
+int growPool(mem_pool_t *pool, size_t needed){
+    size_t page = pool->releasePage;
+    size_t oldSize = pool->size;
+    size_t committed = (oldSize + page - 1) / page * page;
+    size_t added = oldSize > needed ? oldSize : needed;
+    size_t newCommitted;
+    struct memoryList *tail;
+
+    if (needed > pool->mappedSize - oldSize){
+        return 0;
+    }
+    if (added > pool->mappedSize - oldSize){
+        added = pool->mappedSize - oldSize;
+    }
+    newCommitted = (oldSize + added + page - 1) / page * page;
+    if (newCommitted > pool->mappedSize){
+        newCommitted = pool->mappedSize;
     }
-    else if (!strcmp(strategy,"next"))
-    {
-        return Next;
+    if (newCommitted > committed && mprotect((char *)pool->memory + committed, newCommitted - committed, PROT_READ | PROT_WRITE) != 0){
+        return 0;
     }
-    else
-    {
+    pool->size = oldSize + added;
+
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        tagGrow(pool);
+        return 1;
+    }
+    if ((pool->strategy == Bitmap && !granuleResize(pool)) || (!keepsAddressTree(pool) && !startTableResize(pool))){
+        pool->size = oldSize;
         return 0;
     }
+    tail = lastNode(pool);
+    if (tail->alloc == 0 && pool->strategy != Buddy){
+        unindexFreeNode(pool, tail);
+        tail->size += added;
+        indexFreeNode(pool, tail);
+    } else {
+        struct memoryList *node = newNode(pool);
+        if (node == NULL){
+            pool->size = oldSize;
+            return 0;
+        }
+        node->last = NULL;
+        node->next = NULL;
+        node->size = added;
+        node->alloc = 0;
+        node->ptr = (char *)pool->memory + oldSize;
+        insertNodeAfter(pool, tail, node);
+        if (pool->strategy == Buddy){
+            buddyInit(pool, node);
+        } else {
+            indexFreeNode(pool, node);
+        }
+    }
+    return 1;
 }
 
-
-/*
- * These functions are for you to modify however you see fit.  These will not
- * be used in tests, but you may find them useful for debugging.
+/**
+ Turns the memory between the end of the tagged blocks and the new pool
+ size into a free block, merged with the last block if that one is free
  */
+void tagGrow(mem_pool_t *pool){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t end = header->start + (pool->size - header->start) / TAG_ALIGN * TAG_ALIGN;
+    size_t block = header->end;
+    size_t size = end - block;
 
-void printNode(struct memoryList *node)
-{
-    printf("Node{\nNext: %p\nLast: %p\nSize: %zu\nAlloc: %d\nPtr: %p\n}\n",node->next,node->last,node->size,node->alloc,node->ptr);
-}
-
-/* Use this function to print out the current contents of memory. */
-void print_memory()
-{
-    struct memoryList *currentNode = head;
-    while (currentNode != NULL){
-        //Print the node
-        printNode(currentNode);
-        //update
-        currentNode = currentNode->next;
+    if (block > header->start && !(*tagWord(pool, block - TAG_SIZE) & TAG_ALLOC)){
+        size_t left = block - *tagWord(pool, block - TAG_SIZE);
+        tagUnlinkFree(pool, left);
+        size += block - left;
+        block = left;
+    } else if (size < TAG_MIN_BLOCK){
+        return;
     }
-
-    return;
+    header->end = end;
+    tagWrite(pool, block, size, 0);
+    tagPushFree(pool, block);
 }
 
+/**
+ The node at the highest address
+ */
+struct memoryList *lastNode(mem_pool_t *pool){
+    struct memTreeLink *link = pool->nodesByAddress.root;
 
+    if (!keepsAddressTree(pool)){
+        struct memoryList *node = pool->startTable[startBitPrev(pool, pool->startChunks - 1)];
+        while (node->next != NULL){
+            node = node->next; //All in the last chunk with a node
+        }
+        return node;
+    }
+    while (link->right != NULL){
+        link = link->right;
+    }
+    return nodeFromLink(link, byAddress);
+}
 
 /**
- Use this function to track memory allocation performance.
- This function does not depend on your implementation,
- but on the functions you wrote above.
+ Gives the pages after the last allocated block of a MEM_GROWABLE pool
+ back to the OS, down to the size it was created with. mem_pool_total()
+ drops to match. Returns the number of bytes trimmed.
  */
-void print_memory_status()
+size_t mem_pool_trim(mem_pool_t *pool)
 {
-    printf("%d out of %d bytes allocated.\n",mem_allocated(),mem_total());
-    printf("%d bytes are free in %d holes; maximum allocatable block is %d bytes.\n",mem_free(),mem_holes(),mem_largest_free());
-    printf("Average hole size is %f.\n\n",((float)mem_free())/mem_holes());
+    size_t page = pool->releasePage;
+    size_t committed;
+    size_t cut;
+    size_t trimmed;
+
+    if (pool->arenas != NULL || !(pool->flags & MEM_GROWABLE)){
+        return 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    committed = (pool->size + page - 1) / page * page;
+    cut = trimPoint(pool);
+    trimmed = pool->size - cut;
+    pool->size = cut;
+    cut = (cut + page - 1) / page * page;
+    if (cut < committed){
+        char *tail = (char *)pool->memory + cut;
+        //Mapping the range again drops its pages and what it counts against memory
+        if (mmap(tail, committed - cut, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED){
+            //The old mapping is still there; its pages can go, if not what it counts
+            madvise(tail, committed - cut, MADV_DONTNEED);
+            mprotect(tail, committed - cut, PROT_NONE);
+        } else if (pool->flags & MEM_HUGE_PAGES){
+#ifdef MADV_HUGEPAGE
+            //A new mapping starts without the advice poolMemoryAlloc() gave the reserve
+            madvise(tail, committed - cut, MADV_HUGEPAGE);
+#endif
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return trimmed;
 }
 
 /**
- Use this function to see what happens when your malloc and free
- implementations are called.  Run "mem -try <args>" to call this function.
- We have given you a simple example to start.
+ Takes the free tail off the blocks of the pool, as far as it goes beyond
+ minSize, and returns the new size of the pool.
+ The caller holds pool->lock.
  */
-void try_mymem(int argc, char **argv) {
-    strategies strat;
-    void *a, *b, *c, *d, *e;
-    if(argc > 1)
-        strat = strategyFromString(argv[1]);
-    else
-        strat = Worst;
+size_t trimPoint(mem_pool_t *pool){
+    size_t keep = pool->minSize;
+    struct memoryList *tail;
+    size_t offset;
 
+    if (pool->flags & MEM_BOUNDARY_TAGS){
+        struct tagPoolHeader *header = tagPool(pool);
+        size_t block;
+        size_t end;
 
-    /* A simple example.
-       Each algorithm should produce a different layout. */
-    initmem(strat,500);
+        if (header->end == header->start || *tagWord(pool, header->end - TAG_SIZE) & TAG_ALLOC){
+            return pool->size;
+        }
+        block = header->end - *tagWord(pool, header->end - TAG_SIZE);
+        if (keep < block + TAG_MIN_BLOCK){
+            keep = block + TAG_MIN_BLOCK;
+        }
+        end = header->start + (keep - header->start) / TAG_ALIGN * TAG_ALIGN;
+        if (end >= header->end){
+            return pool->size;
+        }
+        tagUnlinkFree(pool, block);
+        tagWrite(pool, block, end - block, 0);
+        tagPushFree(pool, block);
+        header->end = end;
+        return keep;
+    }
+    if (pool->strategy == Buddy){
+        //Whole blocks go; a free block across keep is split until one starts there
+        size_t cut = pool->size;
+        for (;;){
+            tail = lastNode(pool);
+            offset = (size_t)((char *)tail->ptr - (char *)pool->memory);
+            if (tail->alloc != 0){
+                break;
+            }
+            if (offset >= keep && tail != pool->head){
+                unindexFreeNode(pool, tail);
+                removeNode(pool, tail);
+                cut = offset;
+            } else if (offset < keep && offset + tail->size > keep){
+                unindexFreeNode(pool, tail);
+                if (!buddySplit(pool, tail)){
+                    indexFreeNode(pool, tail);
+                    break;
+                }
+                indexFreeNode(pool, tail);
+            } else {
+                break;
+            }
+        }
+        return cut;
+    }
+    tail = lastNode(pool);
+    if (tail->alloc != 0){
+        return pool->size;
+    }
+    offset = (size_t)((char *)tail->ptr - (char *)pool->memory);
+    if (keep < offset){
+        keep = offset;
+    }
+    if (keep >= pool->size){
+        return pool->size;
+    }
+    unindexFreeNode(pool, tail);
+    if (keep == offset){
+        removeNode(pool, tail);
+    } else {
+        tail->size = keep - offset;
+        indexFreeNode(pool, tail);
+    }
+    return keep;
+}
 
-    a = mymalloc(100);
-    b = mymalloc(100);
-    c = mymalloc(100);
-    myfree(b);
-    d = mymalloc(50);
-    myfree(a);
-    e = mymalloc(25);
+//-------------------Pool files--------------------------------------------
+/**
+ Opens the pool kept in the file at path, or makes a new pool of sz bytes
+ there if the file is empty or missing. The pool uses boundary tags and is
+ mapped MAP_SHARED, so blocks and their contents live in the file.
+ Reopening a file that was closed by mem_pool_destroy() takes O(1); after
+ a crash, the blocks are walked once to recover the free list. Blocks
+ allocated before the crash stay allocated. A block freed while the
+ process died may stay allocated too, but is never handed out twice.
+ Only closing the pool msyncs it, so surviving a crash of the OS as well
+ needs the caller to msync. Data in blocks should link blocks by offsets
+ from mem_pool_base(), since the file may be mapped elsewhere next time.
+ The size and contents of an existing pool win over sz; *reopened (if not
+ NULL) says which happened. One pool at a time has the file open: it is
+ locked with flock() until the pool is destroyed, and opening it again
+ meanwhile, from this process or another, fails. Returns NULL if the file
+ can't be used, including files that hold something other than a pool.
+ */
+mem_pool_t *mem_pool_open_file(const char *path, strategies strategy, size_t sz, int *reopened)
+{
+    struct poolFileHeader *file;
+    struct stat status;
+    size_t length;
+    mem_pool_t *pool;
+    int existing;
+    int fd;
 
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0){
+        return NULL;
+    }
+    //Locked before looking at it, so two processes can't both create the pool
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &status) != 0){
+        close(fd);
+        return NULL;
+    }
+    existing = status.st_size > 0;
+    length = existing ? (size_t)status.st_size : POOL_FILE_HEADER + sz;
+    if (length < POOL_FILE_HEADER + sizeof(struct tagPoolHeader) || (!existing && ftruncate(fd, length) != 0)){
+        poolFileAbandon(path, fd, !existing);
+        return NULL;
+    }
+    file = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (file == MAP_FAILED){
+        poolFileAbandon(path, fd, !existing);
+        return NULL;
+    }
+    if (existing && (memcmp(file->magic, POOL_FILE_MAGIC, sizeof(file->magic)) != 0
+                     || file->version != POOL_FILE_VERSION || file->size != length - POOL_FILE_HEADER)){
+        munmap(file, length);
+        close(fd);
+        return NULL;
+    }
+    if (!existing){
+        file->version = POOL_FILE_VERSION;
+        file->size = sz;
+        file->root = TAG_NONE;
+        file->clean = 0;
+    }
+    pool = createPoolAt(strategy, (char *)file + POOL_FILE_HEADER, file->size, MEM_BOUNDARY_TAGS | (existing ? POOL_REOPEN : 0));
+    if (pool == NULL){
+        munmap(file, length);
+        poolFileAbandon(path, fd, !existing);
+        return NULL;
+    }
+    pool->file = file;
+    pool->fileLock = fd;
+    pool->mappedSize = length;
+    pool->minSize = file->size;
+    file->strategy = strategy;
+    if (existing && !file->clean){
+        tagRecover(pool);
+    }
+    if (!existing){
+        //Last, and only once the rest is on disk, so a half made file is never taken for a pool
+        msync(file, length, MS_SYNC);
+        memcpy(file->magic, POOL_FILE_MAGIC, sizeof(file->magic));
+    }
+    //Marked in use before the first change, so a crash from now on is noticed
+    file->clean = 0;
+    msync(file, POOL_FILE_HEADER, MS_SYNC);
+    if (reopened != NULL){
+        *reopened = existing;
+    }
+    return pool;
 }
 
-//------------------------Utility functions---------------------------------
 /**
-Inserts newNode after oldNode
-Doesnt change memory allocation.
+ Closes a pool file that could not be opened as a pool. A file this open
+ sized is cut back to empty, or removed if it can't be, so the next open
+ creates the pool again instead of finding a file without a header.
  */
-void insertNodeAfter(struct memoryList *oldNode, struct memoryList *newNode ){
-    newNode->next = oldNode->next;
-    newNode->last = oldNode;
-    oldNode->next = newNode;
-    if (newNode->next){
-        newNode->next->last = newNode;
+void poolFileAbandon(const char *path, int fd, int sized){
+    if (sized && ftruncate(fd, 0) != 0){
+        unlink(path);
     }
+    close(fd);
 }
 
 /**
- The node is de-alloced.
- Node is merged with any surrounding free nodes
+ Writes the pool back to its file, then marks the file clean, unmaps it
+ and gives up its lock
  */
-void freeNode(struct memoryList *node){
-    // Mark that this node is no longer allocated
-    node->alloc = 0;
-
-    //Check if it should be merged with "left" neighbor
-    int mergeLeft = node->last != NULL && node->last->alloc == 0;
-    int mergeRight = node->next != NULL && node->next->alloc == 0;
+void poolFileClose(mem_pool_t *pool){
+    msync(pool->file, pool->mappedSize, MS_SYNC);
+    pool->file->clean = 1;
+    msync(pool->file, POOL_FILE_HEADER, MS_SYNC);
+    munmap(pool->file, pool->mappedSize);
+    close(pool->fileLock);
+}
 
-    if (mergeLeft){
-        //Important: Update "node" to be the resulting node of the merge
-        //Otherwise we can't use it for merging to the right
-        node = mergeFreeNodes(node->last,node);
+/**
+ Remembers block as the root of the data in a pool file, so it can be
+ found again after the file is reopened. NULL clears it. Other pools
+ have no root.
+ */
+void mem_pool_set_root(mem_pool_t *pool, void *block)
+{
+    if (pool->file != NULL){
+        pool->file->root = block == NULL ? TAG_NONE : (uint64_t)((char *)block - (char *)pool->memory);
     }
+}
 
-    //Check if it should be merged with "right" neighbor
-    if (mergeRight){
-        mergeFreeNodes(node,node->next);
+void *mem_pool_root(mem_pool_t *pool)
+{
+    if (pool->file == NULL || pool->file->root == TAG_NONE){
+        return NULL;
     }
+    return (char *)pool->memory + pool->file->root;
 }
 
-
-
 /**
- Makes 2 free nodes into 1 free node of total size
- The resulting node is the first/leftmost of the two
- The 2 nodes should be neighbors and should both be free (not allocated)
- The address of the resulting node is returned
+ Rebuilds the free list and running totals of a pool whose file was not
+ closed cleanly, from the block headers alone. tagWrite() writes a header
+ after everything else, so a walk over the headers only sees whole blocks,
+ even halfway through a split or merge. Footers, links and totals are
+ written again, and neighboring free blocks are merged. A header that
+ makes no sense ends the walk, and the rest of the pool becomes free.
  */
-struct memoryList *mergeFreeNodes(struct memoryList *firstNode, struct memoryList *lastNode){
-    //Assert that firstNode and lastNode are indeed neighbors
-    if (firstNode->next != lastNode && lastNode->last != firstNode ){
-        printf("Error in mergeFreeNodes(). Nodes are not neighbors");
-        return NULL;
+void tagRecover(mem_pool_t *pool){
+    struct tagPoolHeader *header = tagPool(pool);
+    size_t freeStart = TAG_NONE;
+    size_t block = header->start;
+
+    header->freeList = TAG_NONE;
+    header->rover = TAG_NONE;
+    header->holes = 0;
+    header->allocated = 0;
+    header->free = 0;
+    while (block < header->end){
+        size_t size = tagSize(pool, block);
+
+        if (size < TAG_MIN_BLOCK || size % TAG_ALIGN != 0 || size > header->end - block){
+            if (freeStart == TAG_NONE){
+                freeStart = block;
+            }
+            break;
+        }
+        if (!tagIsAlloc(pool, block)){
+            if (freeStart == TAG_NONE){
+                freeStart = block;
+            }
+        } else {
+            if (freeStart != TAG_NONE){
+                tagWrite(pool, freeStart, block - freeStart, 0);
+                tagPushFree(pool, freeStart);
+                freeStart = TAG_NONE;
+            }
+            tagWrite(pool, block, size, 1);
+            header->allocated += size - TAG_OVERHEAD;
+        }
+        block += size;
     }
-    if (firstNode->alloc != 0 && lastNode->alloc != 0){
-        printf("Error in mergeFreeNodes(). Nodes are not not free");
-        return NULL;
+    if (freeStart != TAG_NONE){
+        if (header->end - freeStart < TAG_MIN_BLOCK){
+            header->end = freeStart; //Too small to be a block
+        } else {
+            tagWrite(pool, freeStart, header->end - freeStart, 0);
+            tagPushFree(pool, freeStart);
+        }
     }
-    //Calculate new size
-    size_t newSize = firstNode->size + lastNode->size;
+}
 
-    //Remove the last node
-    removeNode(lastNode);
+//-------------------Handles and compaction--------------------------------
+/*
+ * A block allocated through a handle may be moved by mem_pool_compact(),
+ * which slides such blocks down over the hole before them, so the holes
+ * between them run together into one. Blocks from mem_pool_malloc() stay
+ * where they are and split the pool into stretches compacted on their own.
+ * Only the list strategies other than Buddy, whose blocks have fixed
+ * places, move blocks.
+ */
+#define COMPACT_VISIT_COST 64 // Budget taken by looking at a node, as if that many bytes had moved
 
-    //Update first node (ptr doesn't need to be updated)
-    firstNode->size = newSize; //Set new size
+/**
+ The node holding ptr, i.e. the one with the highest address <= ptr
+ */
+struct memoryList *nodeHolding(mem_pool_t *pool, void *ptr){
+    struct memTreeLink *link = pool->nodesByAddress.root;
+    struct memoryList *found = NULL;
 
-    //Return resulting node
-    return firstNode;
+    if (!keepsAddressTree(pool)){
+        return startTableHolding(pool, ptr);
+    }
+    while (link){
+        struct memoryList *node = nodeFromLink(link, byAddress);
+        if (node->ptr <= ptr){
+            found = node;
+            link = link->right;
+        } else {
+            link = link->left;
+        }
+    }
+    return found;
 }
 
 /**
- Removes the node from the list and frees it
+ Allocates a block of requested bytes that mem_pool_compact() may move.
+ Returns its handle, which mem_pool_deref() turns into its current
+ address, or 0 if it can't be allocated. Pools with boundary tags or
+ arenas have no handles. Thread caches are skipped.
  */
-void removeNode(struct memoryList *node){
-    struct memoryList *myLast = node->last;
-    struct memoryList *myNext = node->next;
+mem_handle_t mem_pool_malloc_handle(mem_pool_t *pool, size_t requested)
+{
+    struct memoryList *node;
+    void *ptr;
+    size_t handle;
 
-    //If node is head, make head point to next node
-    if (node == head){
-        //This should never happen since we always remove the right node when we merge
-        printf("Removing head node\n");
-        head = head->next;
-        if (head == NULL){
-            printf("ERROR in deleting head\n");
+    if (pool->arenas != NULL || pool->flags & MEM_BOUNDARY_TAGS){
+        return 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->freeHandleCount == 0 && pool->handleCount == pool->handleCapacity){
+        size_t capacity = pool->handleCapacity ? pool->handleCapacity * 2 : 64;
+        void **handles = (void **)realloc(pool->handles, capacity * sizeof(void *));
+        size_t *freeHandles;
+        if (handles != NULL){
+            pool->handles = handles;
         }
-    } else if (node == lastVisited){
-        //If node is lastVisited, update to left neighbor, since it will have same right neighbor now
-        lastVisited = lastVisited->last;
-        if (lastVisited == NULL){
-            printf("ERROR in deleting lastVisited\n");
+        freeHandles = (size_t *)realloc(pool->freeHandles, capacity * sizeof(size_t));
+        if (freeHandles != NULL){
+            pool->freeHandles = freeHandles;
         }
+        if (handles == NULL || freeHandles == NULL){
+            pthread_mutex_unlock(&pool->lock);
+            return 0;
+        }
+        pool->handleCapacity = capacity;
+    }
+    ptr = poolMalloc(pool, 1, requested);
+    if (ptr == NULL){
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
     }
+    handle = pool->freeHandleCount > 0 ? pool->freeHandles[--pool->freeHandleCount] : ++pool->handleCount;
+    node = allocTableFind(pool, ptr);
+    node->handle = handle;
+    pool->handles[handle - 1] = ptr;
+    pthread_mutex_unlock(&pool->lock);
+    return handle;
+}
 
+/**
+ The current address of the block of handle, or NULL for a free handle.
+ It stays valid until the next mem_pool_compact().
+ */
+void *mem_pool_deref(mem_pool_t *pool, mem_handle_t handle)
+{
+    void *ptr = NULL;
 
-    //Make last point to next
-    if (myLast){ //NULL pointer check
-        myLast->next = myNext;
+    pthread_mutex_lock(&pool->lock);
+    if (handle > 0 && handle <= pool->handleCount){
+        ptr = pool->handles[handle - 1];
     }
+    pthread_mutex_unlock(&pool->lock);
+    return ptr;
+}
 
-    //Make next point to last
-    if (myNext){ //NULL pointer check
-        myNext->last = myLast;
-    }
+void mem_pool_free_handle(mem_pool_t *pool, mem_handle_t handle)
+{
+    struct memoryList *node;
 
-    //Free node
-    free(node);
+    pthread_mutex_lock(&pool->lock);
+    if (handle > 0 && handle <= pool->handleCount && pool->handles[handle - 1] != NULL){
+        node = allocTableFind(pool, pool->handles[handle - 1]);
+        node->handle = 0;
+        centralFree(pool, node->ptr);
+        pool->handles[handle - 1] = NULL;
+        pool->freeHandles[pool->freeHandleCount++] = handle;
+    }
+    pthread_mutex_unlock(&pool->lock);
 }
 
 /**
- Either alloc's directly on the node (if size fits excactly)
- Or splits into two nodes, allocating on the first one
+ Compacts the pool for at most budget bytes of work: moving a block costs
+ its size, and looking at a block COMPACT_VISIT_COST. Each call carries on
+ from where the last one stopped, holding the pool lock only for its own
+ slice. A block is moved whole, so one that doesn't fit in what is left of
+ the budget waits for the next call, and one larger than the budget itself
+ stays where it is. Returns 1 while there is more to do; 0 once a pass
+ over the whole pool is done, after which the next call starts a new pass.
  */
-void *allocOnNode(struct memoryList *node, size_t requested){
-    if (node->size == requested){ //If size fits excactly
-        node->alloc = 1;
-    } else { //requested < node->size
-        //Create new node for remaining space
-        size_t remainingSize = node->size - requested;
-        void *remainingMemory = node->ptr + requested;
-        struct memoryList *remainingNode = (struct memoryList*) malloc(sizeof(struct memoryList));
-        if (remainingNode == NULL){
-            printf("MALLOC ERROR!\n)");
-            return NULL;
-        }
-        remainingNode->last = NULL;
-        remainingNode->next = NULL;
-        remainingNode->size = remainingSize;
-        remainingNode->alloc = 0;
-        remainingNode->ptr = remainingMemory;
-        insertNodeAfter(node,remainingNode);
-
-        //Update node
-        node->alloc = 1;
-        node->size = requested;
+int mem_pool_compact(mem_pool_t *pool, size_t budget)
+{
+    struct memoryList *node;
+    size_t spent = 0;
 
+    if (pool->arenas != NULL || pool->flags & MEM_BOUNDARY_TAGS || pool->strategy == Buddy){
+        return 0;
     }
-    return node->ptr;
-}
+    pthread_mutex_lock(&pool->lock);
+    node = nodeHolding(pool, (char *)pool->memory + pool->compactOffset);
+    while (node != NULL && spent < budget){
+        struct memoryList *block = node->next;
 
-//-------------------Malloc functions--------------------------------------
-void *malloc_first(size_t requested){
-    struct memoryList *node = head;
-    while (node)
-    {
-        //If node is free and is big enough
-        int isFree = node->alloc == 0;
-        int isBigEnough = node->size >= requested;
-        if (isFree && isBigEnough){
-            lastVisited = node;
-            return allocOnNode(node,requested);
+        if (node->alloc == 0 && block != NULL && block->handle != 0 && block->size > budget - spent && block->size <= budget){
+            break; //The next call starts at this hole with the whole budget
         }
+        //After a move node holds the block, and the hole to fill next is after it
+        spent += COMPACT_VISIT_COST + compactStep(pool, node, budget - spent);
         node = node->next;
     }
-
-    return NULL;
+    pool->compactOffset = node != NULL ? (size_t)((char *)node->ptr - (char *)pool->memory) : 0;
+    pthread_mutex_unlock(&pool->lock);
+    return node != NULL;
 }
 
-void *malloc_best(size_t requested){
-    struct memoryList *node = head;
-    struct memoryList *bestFit = NULL;
+/**
+ If node is a hole followed by a handle block of at most limit bytes,
+ slides the block down to the start of the hole and returns its size;
+ otherwise returns 0.
+ The two nodes trade places by trading roles: node takes the block and
+ the block's node becomes the hole after it, merged with a hole beyond.
+ Both keep their order by address, so only the hash table, the free
+ indexes, the handle table and startTable need updating. The caller holds pool->lock.
+ */
+size_t compactStep(mem_pool_t *pool, struct memoryList *node, size_t limit){
+    struct memoryList *block = node->next;
+    size_t holeSize = node->size;
 
-    while (node)
-    {
-        //If node is free and fits better than previous
-        int isFree = node->alloc == 0;
-        int isBigEnough = node->size >= requested;
-        int fitsBetter = bestFit == NULL || node->size < bestFit->size;
-        if (isFree && isBigEnough && fitsBetter){
-            bestFit = node;
-        }
-        node = node->next;
-    }
-    if (bestFit == NULL){
-        return NULL;
+    if (node->alloc != 0 || block == NULL || block->handle == 0 || block->size > limit){
+        return 0;
     }
-    lastVisited = bestFit;
-    return allocOnNode(bestFit,requested);
-}
-
+    unindexFreeNode(pool, node);
+    allocTableRemove(pool, block);
+    memmove(node->ptr, block->ptr, block->size);
 
-void *malloc_next(size_t requested){
-    struct memoryList *startNode = lastVisited;//The node that we started on
-    struct memoryList *node = lastVisited;//The node that we use as iterator
+    node->alloc = 1;
+    node->size = block->size;
+    node->handle = block->handle;
+    allocTableInsert(pool, node);
+    pool->handles[node->handle - 1] = node->ptr;
 
-    //Start at next node from lastVisited
-    if (node->next == NULL){
-        node = head;
-    } else {
-        node = node->next;
+    block->alloc = 0;
+    block->handle = 0;
+    if (!keepsAddressTree(pool)){
+        startTableRemove(pool, block);
     }
-
-    int hasLooped = 0;//Tells if we have gone from tail to head already
-    while (node != startNode || !hasLooped) //While we haven't done one whole loop
-    {
-        //If node is free and is big enough
-        int isFree = node->alloc == 0;
-        int isBigEnough = node->size >= requested;
-        if (isFree && isBigEnough){
-            lastVisited = node;
-            return allocOnNode(node,requested);
-        }
-        if (node->next == NULL){
-            node = head;
-            hasLooped = 1;
-        } else {
-            node = node->next;
-        }
+    block->ptr = (char *)node->ptr + node->size;
+    if (!keepsAddressTree(pool)){
+        startTableInsert(pool, block);
     }
-
-    return NULL;
-}
-
-void *malloc_worst(size_t requested){
-    struct memoryList *node = head;
-    struct memoryList *worstFit = NULL;
-
-    while (node)
-    {
-        //If node is free and fits better than previous
-        int isFree = node->alloc == 0;
-        int isBigEnough = node->size >= requested;
-        int fitsWorse = worstFit == NULL || node->size > worstFit->size;
-        if (isFree && isBigEnough && fitsWorse){
-            worstFit = node;
-        }
-        node = node->next;
+    block->size = holeSize;
+    if (pool->granules != NULL){
+        node->requested = block->requested;
+        granuleMark(pool, node->ptr, node->size, 1);
+        granuleMark(pool, block->ptr, block->size, 0);
     }
-    if (worstFit == NULL){
-        return NULL;
+    if (isFreeListed(node)){
+        freeListReplace(pool, node, block);
+    }
+    if (block->next != NULL && block->next->alloc == 0){
+        mergeFreeNodes(pool, block, block->next);
     }
-    lastVisited = worstFit;
-    return allocOnNode(worstFit,requested);
+    indexFreeNode(pool, block);
+    return node->size;
 }
@@ -6,25 +6,118 @@ typedef enum strategies_enum
 	Best = 1,
 	Worst = 2,
 	First = 3,
-	Next = 4
+	Next = 4,
+	Tlsf = 5,
+	Buddy = 6,
+	Bitmap = 7
 } strategies;
 
+/* Number of strategies, i.e. the highest valid strategy value */
+#define NUM_STRATEGIES 7
+
 char *strategy_name(strategies strategy);
 strategies strategyFromString(char * strategy);
 
 
+/* Flags for initmem_flags() */
+#define MEM_BOUNDARY_TAGS 0x1 /* Keep block headers/footers inside the pool instead of list nodes */
+#define MEM_THREAD_CACHE 0x2  /* Per-thread caches of small freed blocks in front of the locked pool.
+                                 Every block gets a 16 byte header, and cached blocks count as
+                                 allocated until mem_flush_cache() or their thread exits. */
+#define MEM_REMOTE_FREE 0x4   /* With arenas, freeing a block of another thread's arena pushes it
+                                 on a lock-free stack that the arena frees on its next allocation.
+                                 Blocks are at least sizeof(void *) bytes. */
+#define MEM_MMAP 0x8          /* Reserve the pool with mmap, so pages are only committed when first
+                                 touched, and give the whole pages inside large free holes back
+                                 to the OS. Freed blocks may read as zero afterwards. */
+#define MEM_HUGE_PAGES 0x10   /* MEM_MMAP with huge pages: reserved ones if the system has them,
+                                 otherwise transparent huge pages */
+#define MEM_GROWABLE 0x20     /* MEM_MMAP that reserves a large address range and commits more of it
+                                 whenever an allocation fails; mem_trim() gives a free tail back.
+                                 Not for pools split into arenas. */
+#define MEM_SMALL_SLABS 0x40  /* Blocks of up to 256 bytes come from 4 KiB slabs of one 16-byte size class
+                                 each, taken from the pool with its strategy; a bitmap in every slab marks
+                                 its blocks. The statistics count a slab as one allocated block; an empty
+                                 slab is kept while no other slab of its class has room, until mem_flush_cache().
+                                 Ignored with MEM_BOUNDARY_TAGS. */
+
+/* A block that mem_compact() may move, found through mem_deref(). 0 is no block. */
+typedef size_t mem_handle_t;
+
+/* Every function is safe to call from several threads at once, except
+ * initmem()/initmem_flags() and mem_pool_destroy(), which must not race
+ * with any other use of the pool.
+ */
+
 void initmem(strategies strategy, size_t sz);
+void initmem_flags(strategies strategy, size_t sz, int flags);
+void initmem_arenas(strategies strategy, size_t sz, int flags, int arenas);
+int initmem_file(const char *path, strategies strategy, size_t sz);
 void *mymalloc(size_t requested);
+void *mymalloc_aligned(size_t alignment, size_t size);
 void myfree(void* block);
+void *myrealloc(void *block, size_t requested);
+int mymalloc_batch(size_t size, void **out, int n);
+void myfree_batch(void **ptrs, int n);
+mem_handle_t mymalloc_handle(size_t requested);
+void *mem_deref(mem_handle_t handle);
+void myfree_handle(mem_handle_t handle);
+int mem_compact(size_t budget);
 
 int mem_holes();
 int mem_allocated();
 int mem_free();
 int mem_total();
+int mem_overhead();
+int mem_internal_fragmentation();
+double mem_external_fragmentation();
 int mem_largest_free();
 int mem_small_free(int size);
+int mem_free_histogram(int *counts, int buckets);
 char mem_is_alloc(void *ptr);
 void* mem_pool();
+void mem_flush_cache();
+size_t mem_trim();
+void mem_set_root(void *block);
+void *mem_root();
 void print_memory();
 void print_memory_status();
+
+/* Independent pools, each with its own strategy, size and flags.
+ * The functions above work on a default pool that initmem() creates.
+ */
+typedef struct mem_pool mem_pool_t;
+
+mem_pool_t *mem_pool_create(strategies strategy, size_t sz, int flags);
+mem_pool_t *mem_pool_open_file(const char *path, strategies strategy, size_t sz, int *reopened);
+mem_pool_t *mem_pool_create_arenas(strategies strategy, size_t sz, int flags, int arenas);
+void mem_pool_destroy(mem_pool_t *pool);
+void *mem_pool_malloc(mem_pool_t *pool, size_t requested);
+void *mem_pool_malloc_aligned(mem_pool_t *pool, size_t alignment, size_t requested);
+void mem_pool_free(mem_pool_t *pool, void *block);
+void *mem_pool_realloc(mem_pool_t *pool, void *block, size_t requested);
+int mem_pool_malloc_batch(mem_pool_t *pool, size_t size, void **out, int n);
+void mem_pool_free_batch(mem_pool_t *pool, void **ptrs, int n);
+mem_handle_t mem_pool_malloc_handle(mem_pool_t *pool, size_t requested);
+void *mem_pool_deref(mem_pool_t *pool, mem_handle_t handle);
+void mem_pool_free_handle(mem_pool_t *pool, mem_handle_t handle);
+int mem_pool_compact(mem_pool_t *pool, size_t budget);
+
+int mem_pool_holes(mem_pool_t *pool);
+int mem_pool_allocated(mem_pool_t *pool);
+int mem_pool_free_bytes(mem_pool_t *pool);
+int mem_pool_total(mem_pool_t *pool);
+int mem_pool_overhead(mem_pool_t *pool);
+int mem_pool_internal_fragmentation(mem_pool_t *pool);
+double mem_pool_external_fragmentation(mem_pool_t *pool);
+int mem_pool_largest_free(mem_pool_t *pool);
+int mem_pool_small_free(mem_pool_t *pool, int size);
+int mem_pool_free_histogram(mem_pool_t *pool, int *counts, int buckets);
+char mem_pool_is_alloc(mem_pool_t *pool, void *ptr);
+void *mem_pool_base(mem_pool_t *pool);
+void mem_pool_flush_cache(mem_pool_t *pool);
+size_t mem_pool_trim(mem_pool_t *pool);
+void mem_pool_set_root(mem_pool_t *pool, void *block);
+void *mem_pool_root(mem_pool_t *pool);
+void mem_pool_print(mem_pool_t *pool);
 void try_mymem(int argc, char **argv);
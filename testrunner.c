@@ -185,7 +185,7 @@ static void print_targets(testentry_t tests[], int count) {
 	for(i=0,previous="";i<count; i++) if(!eql(previous,array[i])) printf(" %s",(previous=array[i]));
 	printf("\nValid strategies: all ");
 
-	for(i=1;i<5;i++)
+	for(i=1;i<=NUM_STRATEGIES;i++)
 	  printf("%s ",strategy_name(i));
 	printf("\n");
 